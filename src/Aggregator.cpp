@@ -0,0 +1,320 @@
+#include "Aggregator.h"
+#include <cstring>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+static const std::string help_str = "list of all commands:\n"
+                                    "* help - displays this help\n"
+                                    "* instances - displays whether each instance replies, and how fast\n"
+                                    "* list - displays the workers of all instances, each prefixed with `[instance]`\n"
+                                    "* query [instance/]<identifier> <key> - querys the worker on every instance which has it, one `instance: value` line each. see `help` of an instance for the keys.\n"
+                                    "* restart [instance/]<identifier> - restarts the worker on every instance which has it\n"
+                                    "Without the `instance/` prefix, commands go to all instances. Instances which can't be reached or don't reply in time are listed with the error, the others' replies are still shown.";
+
+Aggregator::Aggregator(std::string socket_path, std::vector<Instance> instances, std::chrono::milliseconds timeout)
+    : m_socket_path(std::move(socket_path))
+    , m_instances(std::move(instances))
+    , m_timeout(timeout) {
+    info("ServerOrganizer v1.0 Aggregator");
+    for (const auto& instance : m_instances) {
+        info("instance \"" + instance.name + "\" at \"" + instance.socket_path + "\"");
+    }
+}
+
+Aggregator::~Aggregator() {
+    for (auto& instance : m_instances) {
+        disconnect(instance);
+    }
+    unlink(m_socket_path.c_str());
+}
+
+void Aggregator::disconnect(Instance& instance) {
+    if (instance.fd >= 0) {
+        shutdown(instance.fd, SHUT_RDWR);
+        close(instance.fd);
+        instance.fd = -1;
+    }
+}
+
+std::vector<Aggregator::Reply> Aggregator::fan_out(const std::vector<size_t>& targets, const std::string& request) {
+    std::vector<Reply> replies(targets.size());
+    std::vector<std::array<char, 1024>> buffers(targets.size());
+    std::vector<size_t> received(targets.size(), 0);
+    // the replies which are still outstanding, and which target each belongs to
+    std::vector<pollfd> pending;
+    std::vector<size_t> pending_targets;
+    const auto start = std::chrono::steady_clock::now();
+    auto data = Message::from_string(request).serialize();
+    for (size_t i = 0; i < targets.size(); ++i) {
+        auto& instance = m_instances.at(targets.at(i));
+        if (instance.fd < 0) {
+            // non-blocking, so an instance which doesn't accept can't hold up the others
+            instance.fd = connect_to_socket(instance.socket_path, SOCK_NONBLOCK);
+            if (instance.fd < 0) {
+                replies.at(i).text = "unreachable: " + std::string(std::strerror(errno));
+                continue;
+            }
+        }
+        // a single message fits into the socket buffer of an idle connection
+        if (send(instance.fd, data.data(), data.size(), MSG_NOSIGNAL | MSG_DONTWAIT) != ssize_t(data.size())) {
+            replies.at(i).text = "send failed: " + std::string(std::strerror(errno));
+            disconnect(instance);
+            continue;
+        }
+        pending.push_back({ instance.fd, POLLIN, 0 });
+        pending_targets.push_back(i);
+    }
+    const auto deadline = start + m_timeout;
+    while (!pending.empty()) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (left <= 0) {
+            break;
+        }
+        int ret = poll(pending.data(), pending.size(), int(left));
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        } else if (ret <= 0) {
+            break;
+        }
+        for (size_t p = 0; p < pending.size();) {
+            if (pending.at(p).revents == 0) {
+                ++p;
+                continue;
+            }
+            const size_t i = pending_targets.at(p);
+            auto& instance = m_instances.at(targets.at(i));
+            auto& buffer = buffers.at(i);
+            auto n = recv(instance.fd, buffer.data() + received.at(i), buffer.size() - received.at(i), MSG_DONTWAIT);
+            bool done = false;
+            if (n > 0) {
+                received.at(i) += n;
+                if (received.at(i) == buffer.size()) {
+                    replies.at(i).ok = true;
+                    replies.at(i).text = Message::deserialize(buffer).to_string();
+                    replies.at(i).latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+                    done = true;
+                }
+            } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+                replies.at(i).text = n == 0 ? "connection closed" : "recv failed: " + std::string(std::strerror(errno));
+                disconnect(instance);
+                done = true;
+            }
+            if (done) {
+                pending.erase(pending.begin() + p);
+                pending_targets.erase(pending_targets.begin() + p);
+            } else {
+                ++p;
+            }
+        }
+    }
+    // the reply of an instance which timed out may still arrive, so its connection can't be used anymore
+    for (size_t i : pending_targets) {
+        replies.at(i).text = "timed out after " + std::to_string(m_timeout.count()) + "ms";
+        disconnect(m_instances.at(targets.at(i)));
+    }
+    return replies;
+}
+
+std::string Aggregator::command_help(const std::vector<std::string>& args) {
+    if (args.empty()) {
+        return help_str;
+    } else {
+        return "`help` takes no arguments";
+    }
+}
+
+std::string Aggregator::command_instances(const std::vector<std::string>& args) {
+    if (!args.empty()) {
+        return "`instances` takes no arguments";
+    }
+    std::vector<size_t> targets(m_instances.size());
+    for (size_t i = 0; i < targets.size(); ++i) {
+        targets.at(i) = i;
+    }
+    std::lock_guard guard(m_instances_mutex);
+    auto replies = fan_out(targets, "list");
+    std::stringstream ss;
+    for (size_t i = 0; i < replies.size(); ++i) {
+        const auto& instance = m_instances.at(i);
+        ss << instance.name << " (" << instance.socket_path << "): ";
+        if (replies.at(i).ok) {
+            ss << "replied in " << replies.at(i).latency.count() / 1000.0 << "ms\n";
+        } else {
+            ss << "ERROR - " << replies.at(i).text << "\n";
+        }
+    }
+    auto result = ss.str();
+    result.erase(result.size() - 1);
+    return result;
+}
+
+std::string Aggregator::command_list(const std::vector<std::string>& args) {
+    if (!args.empty()) {
+        return "`list` takes no arguments";
+    }
+    std::vector<size_t> targets(m_instances.size());
+    for (size_t i = 0; i < targets.size(); ++i) {
+        targets.at(i) = i;
+    }
+    std::lock_guard guard(m_instances_mutex);
+    auto replies = fan_out(targets, "list");
+    std::stringstream workers;
+    std::stringstream failures;
+    size_t replied = 0;
+    for (size_t i = 0; i < replies.size(); ++i) {
+        const auto& name = m_instances.at(i).name;
+        if (!replies.at(i).ok) {
+            failures << "[" << name << "] ERROR - " << replies.at(i).text << "\n";
+            continue;
+        }
+        replied += 1;
+        std::vector<std::string> lines;
+        split(replies.at(i).text, lines, '\n');
+        // the first line is the instance's own "list of all workers:"
+        for (size_t l = 1; l < lines.size(); ++l) {
+            workers << "[" << name << "] " << lines.at(l) << "\n";
+        }
+    }
+    auto result = "list of all workers on " + std::to_string(replied) + " of " + std::to_string(m_instances.size()) + " instances:\n"
+        + workers.str() + failures.str();
+    result.erase(result.size() - 1);
+    return result;
+}
+
+std::string Aggregator::fan_out_to_worker(const std::string& command, const std::vector<std::string>& args, const std::string& unknown_reply) {
+    // `instance/identifier` only goes to that instance
+    std::string identifier = args.at(0);
+    std::vector<size_t> targets;
+    if (auto slash = identifier.find('/'); slash != std::string::npos) {
+        for (size_t i = 0; i < m_instances.size(); ++i) {
+            if (m_instances.at(i).name == identifier.substr(0, slash)) {
+                targets.push_back(i);
+            }
+        }
+        if (targets.empty()) {
+            return "instance \"" + identifier.substr(0, slash) + "\" unknown";
+        }
+        identifier.erase(0, slash + 1);
+    } else {
+        for (size_t i = 0; i < m_instances.size(); ++i) {
+            targets.push_back(i);
+        }
+    }
+    std::string request = command + " " + identifier;
+    for (size_t i = 1; i < args.size(); ++i) {
+        request += " " + args.at(i);
+    }
+    std::lock_guard guard(m_instances_mutex);
+    auto replies = fan_out(targets, request);
+    std::stringstream found;
+    std::stringstream failures;
+    for (size_t i = 0; i < replies.size(); ++i) {
+        const auto& name = m_instances.at(targets.at(i)).name;
+        if (!replies.at(i).ok) {
+            failures << name << ": ERROR - " << replies.at(i).text << "\n";
+        } else if (replies.at(i).text != unknown_reply) {
+            found << name << ": " << replies.at(i).text << "\n";
+        }
+    }
+    std::string result = found.str();
+    if (result.empty()) {
+        // keep the instances' reply, so scripts can check for it like with a single instance
+        result = unknown_reply;
+        if (!failures.str().empty()) {
+            result += " on the instances which replied\n";
+        }
+    }
+    result += failures.str();
+    if (result.ends_with('\n')) {
+        result.erase(result.size() - 1);
+    }
+    return result;
+}
+
+std::string Aggregator::command_query(const std::vector<std::string>& args) {
+    if (args.size() != 2) {
+        return "ERROR - invalid arguments";
+    }
+    return fan_out_to_worker("query", args, "ERROR - unknown worker");
+}
+
+std::string Aggregator::command_restart(const std::vector<std::string>& args) {
+    if (args.size() != 1) {
+        return "`restart` only takes one argument `[instance/]identifier`";
+    }
+    auto identifier = args.at(0).substr(args.at(0).find('/') + 1);
+    return fan_out_to_worker("restart", args, "worker \"" + identifier + "\" unknown");
+}
+
+Message Aggregator::process_message(Message&& msg) {
+    info("got command: \"" + msg.to_string() + "\"");
+    auto str = msg.to_string();
+    auto command = str.substr(0, str.find_first_of(' '));
+    if (str == "kickme") {
+        return Message::from_string(Command::Detach);
+    } else if (m_command_function_map.contains(command)) {
+        return Message::from_string(m_command_function_map.at(command)(extract_args(str)));
+    } else {
+        return Message::from_string("`" + command + "` isn't aggregated, attach to an instance to use it");
+    }
+}
+
+void Aggregator::run_client(int socket_fd) {
+    info("client connected");
+    while (true) {
+        std::array<char, 1024> data {};
+        int ret = recv(socket_fd, data.data(), data.size(), MSG_WAITALL);
+        if (ret == 0) {
+            break;
+        } else if (ret != int(data.size())) {
+            error("error: received invalid size message: " + std::to_string(ret) + ", with error: " + std::string(std::strerror(errno)));
+            break;
+        }
+        Message request = Message::deserialize(data);
+        auto command = request.to_string().substr(0, request.to_string().find_first_of(' '));
+        Message response = process_message(std::move(request));
+        bool ok = send(socket_fd, response.data, sizeof(response.data), MSG_NOSIGNAL) == sizeof(response.data);
+        // the client waits for the end of a stream after these
+        if (ok && std::find(Command::Streamed.begin(), Command::Streamed.end(), command) != Command::Streamed.end()) {
+            Message end = Message::from_string(Command::StreamEnd);
+            ok = send(socket_fd, end.data, sizeof(end.data), MSG_NOSIGNAL) == sizeof(end.data);
+        }
+        if (!ok || response.to_string() == Command::Detach) {
+            break;
+        }
+    }
+    shutdown(socket_fd, SHUT_RDWR);
+    close(socket_fd);
+    info("client disconnected");
+}
+
+int Aggregator::run() {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un addr {
+        AF_UNIX, { }
+    };
+    strncpy(addr.sun_path, m_socket_path.c_str(), sizeof(addr.sun_path) - 1);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        error("failed to bind: " + std::string(std::strerror(errno)) + " - this is usually caused by the aggregator not shutting down properly. use --clean to force start.");
+        return -1;
+    }
+    if (listen(fd, SOMAXCONN) != 0) {
+        error("failed to listen: " + std::string(std::strerror(errno)));
+        return -1;
+    }
+    info("listening on \"" + m_socket_path + "\"");
+    while (!m_shutdown) {
+        int client_fd = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            error("could not accept(): " + std::string(std::strerror(errno)));
+            continue;
+        }
+        std::thread(&Aggregator::run_client, this, client_fd).detach();
+    }
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,72 @@
+#ifndef SERVERORGANIZER_AGGREGATOR_H
+#define SERVERORGANIZER_AGGREGATOR_H
+
+#include "Common.h"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+static constexpr auto AGGREGATOR_SOCKET_FILENAME = "/tmp/.soag_socket_1_0";
+
+// a view across several headless servers. fans `list`, `query` and `restart` out to all of them in
+// parallel and merges the replies. speaks the same protocol as a headless server, so the client can
+// attach to it like to any instance.
+class Aggregator {
+public:
+    struct Instance {
+        std::string name;
+        std::string socket_path;
+        // kept open between requests, -1 while disconnected. reconnected on the next request.
+        int fd { -1 };
+    };
+
+    Aggregator(std::string socket_path, std::vector<Instance> instances, std::chrono::milliseconds timeout);
+    ~Aggregator();
+
+    std::string command_help(const std::vector<std::string>& args);
+    std::string command_instances(const std::vector<std::string>& args);
+    std::string command_list(const std::vector<std::string>& args);
+    std::string command_query(const std::vector<std::string>& args);
+    std::string command_restart(const std::vector<std::string>& args);
+
+    Message process_message(Message&& msg);
+
+    int run();
+    void run_client(int socket_fd);
+
+private:
+    struct Reply {
+        // false if the instance couldn't be reached or didn't reply in time, `text` says why
+        bool ok { false };
+        std::string text;
+        std::chrono::microseconds latency { 0 };
+    };
+
+    // sends `request` to all `targets` (indices into m_instances) at once, and collects their replies
+    // until the timeout. m_instances_mutex has to be locked.
+    std::vector<Reply> fan_out(const std::vector<size_t>& targets, const std::string& request);
+    // sends `command <identifier> [args...]` to the instances which may have the worker, and merges the
+    // replies of those which do. `unknown_reply` is what an instance replies if it doesn't know the worker.
+    std::string fan_out_to_worker(const std::string& command, const std::vector<std::string>& args, const std::string& unknown_reply);
+    void disconnect(Instance& instance);
+
+    std::string m_socket_path;
+    std::vector<Instance> m_instances;
+    std::chrono::milliseconds m_timeout;
+    // one fan-out at a time, as the connections are shared by all clients
+    std::mutex m_instances_mutex;
+    std::atomic_bool m_shutdown = false;
+    std::map<std::string, std::function<std::string(const std::vector<std::string>&)>> m_command_function_map = {
+        { "help", { [this](const auto& vec) -> std::string { return command_help(vec); } } },
+        { "instances", { [this](const auto& vec) -> std::string { return command_instances(vec); } } },
+        { "list", { [this](const auto& vec) -> std::string { return command_list(vec); } } },
+        { "query", { [this](const auto& vec) -> std::string { return command_query(vec); } } },
+        { "restart", { [this](const auto& vec) -> std::string { return command_restart(vec); } } },
+    };
+};
+
+#endif //SERVERORGANIZER_AGGREGATOR_H
@@ -1,4 +1,11 @@
 #include "Common.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 std::string get_date_time_string() {
     time_t now = time(nullptr);
@@ -18,6 +25,61 @@ std::string get_time_string() {
     return buf;
 }
 
+time_t parse_time_string(const std::string& str) {
+    if (!str.empty() && std::all_of(str.begin(), str.end(), ::isdigit)) {
+        // too large for a time_t is just as invalid as any other garbage
+        errno = 0;
+        long long seconds = std::strtoll(str.c_str(), nullptr, 10);
+        if (errno == ERANGE || seconds > std::numeric_limits<time_t>::max()) {
+            return -1;
+        }
+        return time_t(seconds);
+    }
+    time_t now = time(nullptr);
+    struct tm tstruct { };
+    tstruct = *localtime(&now);
+    const char* end = strptime(str.c_str(), "%Y-%m-%dT%H:%M:%S", &tstruct);
+    if (!end || *end != '\0') {
+        tstruct = *localtime(&now);
+        end = strptime(str.c_str(), "%H:%M:%S", &tstruct);
+        if (!end || *end != '\0') {
+            return -1;
+        }
+    }
+    tstruct.tm_isdst = -1;
+    return mktime(&tstruct);
+}
+
+std::string worker_directory(const std::string& root, const std::string& identifier) {
+    return root + "/" + identifier;
+}
+
+bool is_valid_identifier(const std::string& identifier) {
+    return !identifier.empty() && identifier != "." && identifier != ".." && identifier.find('/') == std::string::npos;
+}
+
+int connect_to_socket(const std::string& path, int flags) {
+    struct sockaddr_un addr {
+        AF_UNIX, { }
+    };
+    if (path.size() >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | flags, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
 std::string generate_logfile_name(const std::string& prefix) {
     time_t now = time(nullptr);
     struct tm tstruct { };
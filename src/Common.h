@@ -6,12 +6,25 @@
 #include <ctime>
 #include <iterator>
 #include <string>
+#include <vector>
 
+// defaults, a headless server can be started with --socket to run next to others, see ServerConfig
 static constexpr auto SOCKET_FILENAME = "/tmp/.sohs_socket_1_0";
+static constexpr auto WORKER_DIRECTORY_ROOT = "/tmp/ServerOrganizer";
 
 std::string generate_logfile_name(const std::string& prefix);
 std::string get_date_time_string();
 std::string get_time_string();
+// parses unix timestamps, "%Y-%m-%dT%H:%M:%S" and "%H:%M:%S" (today), returns -1 on failure
+time_t parse_time_string(const std::string& str);
+// each worker's log segments and event journal are kept in <root>/<identifier>/
+std::string worker_directory(const std::string& root, const std::string& identifier);
+// whether `identifier` names a single directory in the root, so it isn't empty, "." or ".." and has no '/'.
+// the aggregator relies on the latter for its `instance/identifier` syntax, too.
+bool is_valid_identifier(const std::string& identifier);
+// connects to the unix socket of a headless server or aggregator. `flags` are or'd into the socket type,
+// e.g. SOCK_NONBLOCK. returns the fd, or -1 with errno set.
+int connect_to_socket(const std::string& path, int flags = 0);
 
 struct Message {
     char data[1024] {};
@@ -25,6 +38,10 @@ struct Message {
 
 namespace Command {
 static inline const std::string Detach = "_do_detach_now";
+// ends a response which consists of multiple messages
+static inline const std::string StreamEnd = "_stream_end_now";
+// commands which are replied to with a stream of messages ended by StreamEnd
+static inline const std::vector<std::string> Streamed = { "logs", "events" };
 }
 
 // from https://stackoverflow.com/questions/216823/whats-the-best-way-to-trim-stdstring
@@ -0,0 +1,271 @@
+#include "EventJournal.h"
+#include "Common.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int64_t event_time_now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::string event_journal_path(const std::string& directory) {
+    return directory + "/events.journal";
+}
+
+EventJournal::EventJournal(const std::string& directory)
+    : m_path(event_journal_path(directory)) {
+    m_fd = open(m_path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (m_fd < 0) {
+        error("open \"" + m_path + "\" failed: " + std::string(std::strerror(errno)));
+        return;
+    }
+    // a partial record from a crash would misalign everything after it
+    struct stat st { };
+    if (fstat(m_fd, &st) == 0 && st.st_size % sizeof(EventRecord) != 0) {
+        warn("\"" + m_path + "\" ends in a partial record, truncating it");
+        if (ftruncate(m_fd, st.st_size - st.st_size % sizeof(EventRecord)) != 0) {
+            error("ftruncate \"" + m_path + "\" failed: " + std::string(std::strerror(errno)));
+        }
+    }
+    // continue the restart latency from where the last run left off
+    EventJournalReader reader(m_path);
+    auto records = reader.records();
+    if (!records.empty() && records.back().type != EventType::Started) {
+        m_last_stop = records.back().timestamp;
+    }
+}
+
+EventJournal::~EventJournal() {
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+void EventJournal::append(EventRecord record) {
+    if (m_fd < 0) {
+        return;
+    }
+    // O_APPEND and a single write keep records whole, even with several writers
+    if (write(m_fd, &record, sizeof(record)) != sizeof(record)) {
+        error("write to \"" + m_path + "\" failed: " + std::string(std::strerror(errno)));
+    }
+}
+
+void EventJournal::record_start(int pid, EventReason reason) {
+    std::lock_guard guard(m_mutex);
+    EventRecord record {};
+    record.timestamp = event_time_now();
+    record.duration = m_last_stop < 0 ? -1 : record.timestamp - m_last_stop;
+    record.pid = pid;
+    record.type = EventType::Started;
+    record.reason = reason;
+    m_last_stop = -1;
+    m_last_started_pid = pid;
+    append(record);
+}
+
+void EventJournal::record_exit(int pid, bool signalled, int code, bool requested, int64_t ran_for_us) {
+    std::lock_guard guard(m_mutex);
+    EventRecord record {};
+    record.timestamp = event_time_now();
+    record.duration = ran_for_us;
+    record.pid = pid;
+    record.code = code;
+    record.type = signalled ? EventType::Signalled : EventType::Exited;
+    record.reason = requested ? EventReason::Requested : EventReason::None;
+    if (pid == m_last_started_pid) {
+        m_last_stop = record.timestamp;
+    }
+    append(record);
+}
+
+void EventJournal::record_remove() {
+    std::lock_guard guard(m_mutex);
+    EventRecord record {};
+    record.timestamp = event_time_now();
+    record.duration = -1;
+    record.type = EventType::Removed;
+    append(record);
+}
+
+void EventJournal::record_stop_requested() {
+    std::lock_guard guard(m_mutex);
+    if (m_last_stop < 0) {
+        m_last_stop = event_time_now();
+    }
+}
+
+EventJournalReader::EventJournalReader(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st { };
+    if (fstat(fd, &st) == 0) {
+        m_size = st.st_size - st.st_size % sizeof(EventRecord);
+    }
+    if (m_size > 0) {
+        void* map = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            error("mmap of \"" + path + "\" failed: " + std::string(std::strerror(errno)));
+        } else {
+            m_map = map;
+            madvise(m_map, m_size, MADV_SEQUENTIAL);
+        }
+    }
+    close(fd);
+}
+
+EventJournalReader::~EventJournalReader() {
+    if (m_map) {
+        munmap(m_map, m_size);
+    }
+}
+
+std::span<const EventRecord> EventJournalReader::records() const {
+    if (!m_map) {
+        return {};
+    }
+    return { static_cast<const EventRecord*>(m_map), m_size / sizeof(EventRecord) };
+}
+
+int64_t UptimeStats::restart_latency_percentile(double p) const {
+    if (restart_latencies.empty()) {
+        return -1;
+    }
+    auto index = size_t(p * double(restart_latencies.size() - 1) + 0.5);
+    return restart_latencies.at(std::min(index, restart_latencies.size() - 1));
+}
+
+UptimeStats compute_uptime(std::span<const EventRecord> records, int64_t since, int64_t until) {
+    UptimeStats stats {};
+    until = std::min(until, event_time_now());
+    // the state is built up from all records in the order they were written. timestamps are wall clock
+    // time, which can step backwards, so they aren't necessarily sorted. the time between two records only
+    // counts for the part which lies in the range, an interval across a backwards step counts as empty.
+    std::vector<int32_t> running;
+    bool registered = false;
+    int64_t previous = -1;
+    auto add_interval = [&](int64_t from, int64_t to) {
+        from = std::max(from, since);
+        to = std::min(to, until);
+        if (from >= to) {
+            return;
+        }
+        if (registered) {
+            stats.observed += to - from;
+        }
+        if (!running.empty()) {
+            stats.uptime += to - from;
+        }
+    };
+    for (const auto& record : records) {
+        if (previous >= 0) {
+            add_interval(previous, record.timestamp);
+        }
+        previous = record.timestamp;
+        const bool in_range = record.timestamp >= since && record.timestamp <= until;
+        switch (record.type) {
+        case EventType::Started:
+            if (record.reason == EventReason::Register) {
+                // instances from before a daemon restart never got their exit recorded
+                running.clear();
+            }
+            running.push_back(record.pid);
+            registered = true;
+            if (in_range) {
+                stats.starts += 1;
+                if (record.reason == EventReason::Restart || record.reason == EventReason::Autorestart || record.reason == EventReason::Handover) {
+                    stats.restarts += 1;
+                    if (record.duration >= 0) {
+                        stats.restart_latencies.push_back(record.duration);
+                    }
+                }
+            }
+            break;
+        case EventType::Exited:
+        case EventType::Signalled:
+            std::erase(running, record.pid);
+            if (in_range && record.reason != EventReason::Requested
+                && (record.type == EventType::Signalled || record.code != 0)) {
+                stats.crashes += 1;
+            }
+            break;
+        case EventType::Removed:
+            running.clear();
+            registered = false;
+            break;
+        }
+    }
+    if (previous >= 0) {
+        add_interval(previous, until);
+    }
+    std::sort(stats.restart_latencies.begin(), stats.restart_latencies.end());
+    return stats;
+}
+
+static std::string event_reason_to_string(EventReason reason) {
+    switch (reason) {
+    case EventReason::Register:
+        return "register";
+    case EventReason::Restart:
+        return "restart";
+    case EventReason::Autorestart:
+        return "autorestart";
+    case EventReason::Handover:
+        return "handover";
+    case EventReason::Requested:
+        return "requested";
+    default:
+        return "";
+    }
+}
+
+std::string event_to_string(const EventRecord& record) {
+    time_t seconds = record.timestamp / 1000000;
+    struct tm tstruct { };
+    char buf[80];
+    tstruct = *localtime(&seconds);
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tstruct);
+    std::string result = buf;
+    switch (record.type) {
+    case EventType::Started:
+        result += " started pid " + std::to_string(record.pid) + " (" + event_reason_to_string(record.reason);
+        if (record.duration >= 0) {
+            result += ", " + format_duration(record.duration) + " after it stopped";
+        }
+        return result + ")";
+    case EventType::Exited:
+        result += " pid " + std::to_string(record.pid) + " exited with code " + std::to_string(record.code);
+        break;
+    case EventType::Signalled:
+        result += " pid " + std::to_string(record.pid) + " exited via " + std::string(strsignal(record.code));
+        break;
+    case EventType::Removed:
+        return result + " removed";
+    }
+    result += " after " + format_duration(record.duration);
+    if (record.reason == EventReason::Requested) {
+        result += " (requested)";
+    }
+    return result;
+}
+
+std::string format_duration(int64_t us) {
+    char buf[64];
+    const int64_t s = us / 1000000;
+    if (s < 60) {
+        snprintf(buf, sizeof(buf), "%.2fs", double(us) / 1e6);
+    } else if (s < 60 * 60) {
+        snprintf(buf, sizeof(buf), "%lldm %llds", (long long)(s / 60), (long long)(s % 60));
+    } else if (s < 24 * 60 * 60) {
+        snprintf(buf, sizeof(buf), "%lldh %lldm", (long long)(s / 3600), (long long)(s % 3600 / 60));
+    } else {
+        snprintf(buf, sizeof(buf), "%lldd %lldh", (long long)(s / 86400), (long long)(s % 86400 / 3600));
+    }
+    return buf;
+}
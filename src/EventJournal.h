@@ -0,0 +1,118 @@
+#ifndef SERVERORGANIZER_EVENTJOURNAL_H
+#define SERVERORGANIZER_EVENTJOURNAL_H
+
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+
+enum class EventType : uint8_t {
+    Started = 0,
+    Exited = 1,
+    Signalled = 2,
+    Removed = 3,
+};
+
+enum class EventReason : uint8_t {
+    None = 0,
+    // Started
+    Register = 1,
+    Restart = 2,
+    Autorestart = 3,
+    Handover = 4,
+    // Exited, Signalled: the daemon terminated it for a restart/remove, so it's not a crash
+    Requested = 5,
+};
+
+// one lifecycle transition of a worker. fixed size and appended with a single write(),
+// so the journal can be mmap'd and read as an array while it's being written.
+struct EventRecord {
+    // unix time in microseconds
+    int64_t timestamp;
+    // Started: microseconds since the worker last stopped, or -1 if it wasn't stopped (first start, handover).
+    // Exited, Signalled: how long the worker ran in microseconds.
+    int64_t duration;
+    int32_t pid;
+    // exit code or signal number
+    int32_t code;
+    EventType type;
+    EventReason reason;
+    uint8_t reserved[6];
+};
+static_assert(sizeof(EventRecord) == 32, "EventRecord is stored as-is and must not change size");
+
+std::string event_journal_path(const std::string& directory);
+
+// the append-only journal of a worker's lifecycle events, at event_journal_path(directory)
+class EventJournal {
+public:
+    explicit EventJournal(const std::string& directory);
+    ~EventJournal();
+
+    const std::string& path() const { return m_path; }
+
+    void record_start(int pid, EventReason reason);
+    void record_exit(int pid, bool signalled, int code, bool requested, int64_t ran_for_us);
+    void record_remove();
+    // the worker is being stopped for a restart. the next start's restart latency counts from here,
+    // unless it already stopped on its own.
+    void record_stop_requested();
+
+private:
+    void append(EventRecord record);
+
+    std::string m_path;
+    int m_fd { -1 };
+    std::mutex m_mutex;
+    // for the restart latency in Started records, -1 if the worker didn't stop since it was last started
+    int64_t m_last_stop { -1 };
+    // only the exit of the newest instance stops the worker, older ones exit after it was restarted
+    int32_t m_last_started_pid { 0 };
+};
+
+// maps a journal read-only. records appended after construction aren't visible.
+class EventJournalReader {
+public:
+    explicit EventJournalReader(const std::string& path);
+    ~EventJournalReader();
+    EventJournalReader(const EventJournalReader&) = delete;
+    EventJournalReader& operator=(const EventJournalReader&) = delete;
+
+    std::span<const EventRecord> records() const;
+
+private:
+    void* m_map { nullptr };
+    size_t m_size { 0 };
+};
+
+struct UptimeStats {
+    // microseconds during which the worker was registered (between start and remove)
+    int64_t observed { 0 };
+    // microseconds during which at least one instance was running
+    int64_t uptime { 0 };
+    uint64_t starts { 0 };
+    uint64_t restarts { 0 };
+    // exits which weren't requested by the daemon, and weren't exit code 0
+    uint64_t crashes { 0 };
+    // restart latencies in microseconds, sorted
+    std::vector<int64_t> restart_latencies;
+
+    double availability() const { return observed > 0 ? double(uptime) / double(observed) : 0.0; }
+    // mean time between failures in microseconds, -1 if there were none
+    int64_t mtbf() const { return crashes > 0 ? uptime / int64_t(crashes) : -1; }
+    // `p` in [0, 1], -1 if there were no restarts
+    int64_t restart_latency_percentile(double p) const;
+};
+
+// computes the stats for [since, until] (unix time in microseconds) in one pass over `records`, in the
+// order they were written. like `events`, it doesn't rely on their timestamps being sorted.
+UptimeStats compute_uptime(std::span<const EventRecord> records, int64_t since, int64_t until);
+
+int64_t event_time_now();
+std::string event_to_string(const EventRecord& record);
+// "3d 2h", "4m 12s", "0.25s"
+std::string format_duration(int64_t us);
+
+#endif //SERVERORGANIZER_EVENTJOURNAL_H
@@ -0,0 +1,155 @@
+#include "ListenSocket.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+int create_listen_socket(const std::string& address) {
+    int fd = -1;
+    if (address.starts_with('/')) {
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            error("socket() failed: " + std::string(std::strerror(errno)));
+            return -1;
+        }
+        struct sockaddr_un addr {
+            AF_UNIX, { }
+        };
+        strncpy(addr.sun_path, address.c_str(), sizeof(addr.sun_path) - 1);
+        // a stale socket file from a previous run would make bind fail. anything else at that path is
+        // left alone, including sockets someone still listens on, clients can pick any path the daemon can write to.
+        struct stat st { };
+        if (lstat(address.c_str(), &st) == 0) {
+            if (!S_ISSOCK(st.st_mode)) {
+                error("failed to bind \"" + address + "\": address in use by something other than a socket");
+                close(fd);
+                return -1;
+            }
+            int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            bool stale = probe >= 0 && connect(probe, (struct sockaddr*)&addr, sizeof(addr)) != 0 && errno == ECONNREFUSED;
+            if (probe >= 0) {
+                close(probe);
+            }
+            if (!stale) {
+                error("failed to bind \"" + address + "\": address in use by a socket which is still listening");
+                close(fd);
+                return -1;
+            }
+            unlink(address.c_str());
+        }
+        if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            error("failed to bind \"" + address + "\": " + std::string(std::strerror(errno)));
+            close(fd);
+            return -1;
+        }
+    } else {
+        int port = 0;
+        try {
+            port = std::stoi(address);
+        } catch (const std::exception&) {
+            error("invalid listen address \"" + address + "\", expected a port or an absolute path");
+            return -1;
+        }
+        if (port <= 0 || port > 65535) {
+            error("port " + address + " out of range");
+            return -1;
+        }
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            error("socket() failed: " + std::string(std::strerror(errno)));
+            return -1;
+        }
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        struct sockaddr_in addr { };
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+        if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            error("failed to bind port " + address + ": " + std::string(std::strerror(errno)));
+            close(fd);
+            return -1;
+        }
+    }
+    // while no worker is accepting, connections queue up in the backlog instead of being refused
+    if (listen(fd, SOMAXCONN) != 0) {
+        error("failed to listen on \"" + address + "\": " + std::string(std::strerror(errno)));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void close_listen_socket(ListenSocket& sock) {
+    if (sock.fd < 0) {
+        return;
+    }
+    close(sock.fd);
+    sock.fd = -1;
+    if (sock.address.starts_with('/')) {
+        unlink(sock.address.c_str());
+    }
+}
+
+bool pass_listen_sockets_to_child(const std::vector<ListenSocket>& sockets) {
+    if (sockets.empty()) {
+        return true;
+    }
+    // first move everything out of the way, so that dup2'ing onto 3, 4, ... can't clobber
+    // a socket which hasn't been moved yet
+    std::vector<int> moved;
+    for (const auto& sock : sockets) {
+        int fd = fcntl(sock.fd, F_DUPFD_CLOEXEC, LISTEN_FDS_START + int(sockets.size()));
+        if (fd < 0) {
+            return false;
+        }
+        moved.push_back(fd);
+    }
+    std::string names;
+    for (size_t i = 0; i < moved.size(); ++i) {
+        // dup2 clears FD_CLOEXEC on the new fd, so these survive the exec
+        if (dup2(moved.at(i), LISTEN_FDS_START + int(i)) < 0) {
+            return false;
+        }
+        close(moved.at(i));
+        if (!names.empty()) {
+            names += ":";
+        }
+        names += sockets.at(i).address;
+    }
+    setenv("LISTEN_FDS", std::to_string(sockets.size()).c_str(), 1);
+    setenv("LISTEN_PID", std::to_string(getpid()).c_str(), 1);
+    setenv("LISTEN_FDNAMES", names.c_str(), 1);
+    return true;
+}
+
+bool send_message_with_fds(int socket_fd, Message& msg, const std::vector<int>& fds) {
+    auto data = msg.serialize();
+    struct iovec iov {
+        data.data(), data.size()
+    };
+    struct msghdr hdr { };
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    std::vector<char> control;
+    if (!fds.empty()) {
+        control.resize(CMSG_SPACE(sizeof(int) * fds.size()));
+        hdr.msg_control = control.data();
+        hdr.msg_controllen = control.size();
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+    }
+    auto ret = sendmsg(socket_fd, &hdr, MSG_NOSIGNAL);
+    if (ret != ssize_t(data.size())) {
+        error("error during sendmsg: " + std::string(std::strerror(errno)));
+        return false;
+    }
+    return true;
+}
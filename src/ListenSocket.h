@@ -0,0 +1,31 @@
+#ifndef SERVERORGANIZER_LISTENSOCKET_H
+#define SERVERORGANIZER_LISTENSOCKET_H
+
+#include "Common.h"
+#include <string>
+#include <vector>
+
+// the first fd passed to a worker, as in systemd's sd_listen_fds()
+static constexpr int LISTEN_FDS_START = 3;
+
+// a listening socket owned by the daemon, which outlives the workers using it,
+// so restarting a worker never closes the port.
+struct ListenSocket {
+    int fd { -1 };
+    // the address as given by the user, either a tcp port or an absolute unix socket path
+    std::string address;
+};
+
+// creates, binds and listens on a socket for `address`. a numeric address is a tcp port,
+// an address starting with '/' is a unix socket path. returns -1 on failure.
+int create_listen_socket(const std::string& address);
+void close_listen_socket(ListenSocket& sock);
+
+// only call this in a freshly forked child. moves the sockets to fds 3, 4, ... and sets
+// LISTEN_FDS, LISTEN_PID and LISTEN_FDNAMES, so the worker can use them like systemd's.
+bool pass_listen_sockets_to_child(const std::vector<ListenSocket>& sockets);
+
+// sends `msg` with `fds` attached as SCM_RIGHTS ancillary data.
+bool send_message_with_fds(int socket_fd, Message& msg, const std::vector<int>& fds);
+
+#endif //SERVERORGANIZER_LISTENSOCKET_H
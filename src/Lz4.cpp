@@ -0,0 +1,145 @@
+#include "Lz4.h"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+static constexpr size_t MIN_MATCH = 4;
+// the format requires the last 5 bytes to be literals, and the last match to start 12 bytes before the end
+static constexpr size_t LAST_LITERALS = 5;
+static constexpr size_t MATCH_FIND_LIMIT = 12;
+static constexpr size_t MAX_OFFSET = 65535;
+static constexpr int HASH_LOG = 16;
+
+static uint32_t read32(const char* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t hash32(uint32_t value) {
+    return (value * 2654435761u) >> (32 - HASH_LOG);
+}
+
+// writes the 255, 255, ..., rest encoding of a length which didn't fit into its token nibble
+static char* write_length(char* op, size_t length) {
+    while (length >= 255) {
+        *op++ = char(255);
+        length -= 255;
+    }
+    *op++ = char(length);
+    return op;
+}
+
+static char* write_literals(char* op, const char* literals, size_t length, uint8_t& token) {
+    token = uint8_t((length >= 15 ? 15 : length) << 4);
+    if (length >= 15) {
+        op = write_length(op, length - 15);
+    }
+    std::memcpy(op, literals, length);
+    return op + length;
+}
+
+size_t lz4_compress_bound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+size_t lz4_compress(const char* src, size_t size, char* dst, size_t capacity) {
+    if (capacity < lz4_compress_bound(size)) {
+        return 0;
+    }
+    char* op = dst;
+    size_t anchor = 0;
+    if (size > MATCH_FIND_LIMIT) {
+        // positions + 1, so that 0 means "nothing here yet"
+        std::vector<uint32_t> table(size_t(1) << HASH_LOG, 0);
+        const size_t limit = size - MATCH_FIND_LIMIT;
+        size_t ip = 0;
+        while (ip < limit) {
+            const uint32_t h = hash32(read32(src + ip));
+            const size_t candidate = table[h];
+            table[h] = uint32_t(ip + 1);
+            if (candidate == 0 || ip - (candidate - 1) > MAX_OFFSET || read32(src + candidate - 1) != read32(src + ip)) {
+                ++ip;
+                continue;
+            }
+            const size_t ref = candidate - 1;
+            size_t match_length = MIN_MATCH;
+            while (ip + match_length < size - LAST_LITERALS && src[ref + match_length] == src[ip + match_length]) {
+                ++match_length;
+            }
+            char* token_pos = op++;
+            uint8_t token;
+            op = write_literals(op, src + anchor, ip - anchor, token);
+            const size_t offset = ip - ref;
+            *op++ = char(offset & 0xff);
+            *op++ = char(offset >> 8);
+            const size_t length_code = match_length - MIN_MATCH;
+            token |= uint8_t(length_code >= 15 ? 15 : length_code);
+            if (length_code >= 15) {
+                op = write_length(op, length_code - 15);
+            }
+            *token_pos = char(token);
+            ip += match_length;
+            anchor = ip;
+        }
+    }
+    char* token_pos = op++;
+    uint8_t token;
+    op = write_literals(op, src + anchor, size - anchor, token);
+    *token_pos = char(token);
+    return op - dst;
+}
+
+long lz4_decompress(const char* src, size_t size, char* dst, size_t capacity) {
+    size_t ip = 0;
+    size_t op = 0;
+    auto read_length = [&](size_t& length) {
+        uint8_t b;
+        do {
+            if (ip >= size) {
+                return false;
+            }
+            b = uint8_t(src[ip++]);
+            length += b;
+        } while (b == 255);
+        return true;
+    };
+    while (ip < size) {
+        const uint8_t token = uint8_t(src[ip++]);
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !read_length(literal_length)) {
+            return -1;
+        }
+        if (literal_length > size - ip || literal_length > capacity - op) {
+            return -1;
+        }
+        std::memcpy(dst + op, src + ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+        if (ip == size) {
+            // the last sequence only has literals
+            break;
+        }
+        if (size - ip < 2) {
+            return -1;
+        }
+        const size_t offset = uint8_t(src[ip]) | (size_t(uint8_t(src[ip + 1])) << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) {
+            return -1;
+        }
+        size_t match_length = token & 15;
+        if (match_length == 15 && !read_length(match_length)) {
+            return -1;
+        }
+        match_length += MIN_MATCH;
+        if (match_length > capacity - op) {
+            return -1;
+        }
+        // matches may overlap their own output, so this has to go byte by byte
+        for (size_t i = 0; i < match_length; ++i, ++op) {
+            dst[op] = dst[op - offset];
+        }
+    }
+    return long(op);
+}
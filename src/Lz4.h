@@ -0,0 +1,16 @@
+#ifndef SERVERORGANIZER_LZ4_H
+#define SERVERORGANIZER_LZ4_H
+
+#include <cstddef>
+
+// a small implementation of the LZ4 block format (no frames, no dictionaries), used
+// to compress sealed log segments. output is readable by any LZ4 block decoder.
+
+// the worst case compressed size of `size` bytes
+size_t lz4_compress_bound(size_t size);
+// `capacity` has to be at least lz4_compress_bound(size). returns the compressed size.
+size_t lz4_compress(const char* src, size_t size, char* dst, size_t capacity);
+// returns the decompressed size, or -1 if the input is malformed or doesn't fit into `capacity`.
+long lz4_decompress(const char* src, size_t size, char* dst, size_t capacity);
+
+#endif //SERVERORGANIZER_LZ4_H
@@ -0,0 +1,149 @@
+#include "OutputBudget.h"
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+void OutputBudget::set_limit(uint64_t bytes_per_sec, uint64_t lines_per_sec) {
+    std::lock_guard guard(m_mutex);
+    m_bytes_limit = bytes_per_sec;
+    m_lines_limit = lines_per_sec;
+    // start with a full bucket
+    m_byte_tokens = double(bytes_per_sec);
+    m_line_tokens = double(lines_per_sec);
+    m_last_refill = Clock::now();
+}
+
+uint64_t OutputBudget::bytes_limit() {
+    std::lock_guard guard(m_mutex);
+    return m_bytes_limit;
+}
+
+uint64_t OutputBudget::lines_limit() {
+    std::lock_guard guard(m_mutex);
+    return m_lines_limit;
+}
+
+void OutputBudget::refill(Clock::time_point now) {
+    const double elapsed = std::chrono::duration<double>(now - m_last_refill).count();
+    m_last_refill = now;
+    // the bucket holds at most one second's worth, which is the largest burst we allow
+    m_byte_tokens = std::min(double(m_bytes_limit), m_byte_tokens + elapsed * double(m_bytes_limit));
+    m_line_tokens = std::min(double(m_lines_limit), m_line_tokens + elapsed * double(m_lines_limit));
+}
+
+void OutputBudget::update_rates(Clock::time_point now, size_t bytes, size_t lines) {
+    const double elapsed = std::chrono::duration<double>(now - m_window_start).count();
+    if (elapsed >= 1.0) {
+        m_bytes_rate = double(m_window_bytes) / elapsed;
+        m_lines_rate = double(m_window_lines) / elapsed;
+        m_window_start = now;
+        m_window_bytes = 0;
+        m_window_lines = 0;
+    }
+    m_window_bytes += bytes;
+    m_window_lines += lines;
+}
+
+void OutputBudget::write_marker(const std::string& text, const std::function<void(const char*, size_t)>& write) {
+    // the marker gets its own line, even if the last written line wasn't finished
+    std::string marker;
+    if (!m_written_line_complete) {
+        marker += '\n';
+    }
+    marker += "[ServerOrganizer] ";
+    marker += text;
+    marker += '\n';
+    write(marker.data(), marker.size());
+    m_written_line_complete = true;
+}
+
+void OutputBudget::resume_if_quiet(Clock::time_point now, const std::function<void(const char*, size_t)>& write) {
+    // only call it over once nothing was dropped for a while, so a worker which is
+    // constantly over the limit doesn't get markers in between every line
+    if (m_throttled && now - m_last_drop >= std::chrono::seconds(1)) {
+        m_throttled = false;
+        write_marker("output rate limit: resuming output, dropped " + std::to_string(m_throttle_dropped_bytes)
+                + " bytes in " + std::to_string(m_throttle_dropped_lines) + " lines",
+            write);
+    }
+}
+
+void OutputBudget::tick(const std::function<void(const char*, size_t)>& write) {
+    std::lock_guard guard(m_mutex);
+    resume_if_quiet(Clock::now(), write);
+}
+
+void OutputBudget::admit(const char* data, size_t size, const std::function<void(const char*, size_t)>& write) {
+    const auto now = Clock::now();
+    std::lock_guard guard(m_mutex);
+    resume_if_quiet(now, write);
+    if (m_bytes_limit == 0 && m_lines_limit == 0) {
+        update_rates(now, size, std::count(data, data + size, '\n'));
+        write(data, size);
+        m_written_line_complete = data[size - 1] == '\n';
+        return;
+    }
+    refill(now);
+    size_t lines = 0;
+    const char* pos = data;
+    const char* end = data + size;
+    while (pos < end) {
+        auto newline = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+        const char* piece_end = newline ? newline + 1 : end;
+        const size_t piece_size = piece_end - pos;
+        const bool line_complete = newline != nullptr;
+        lines += line_complete;
+        // pieces which continue a line share the decision of its first piece, and
+        // only the piece finishing a line costs a line token
+        bool fits = true;
+        if (m_dropping_line) {
+            fits = false;
+        } else if (m_written_line_complete) {
+            // the bucket never holds more than the limit, so a longer line only has to wait for a full one
+            fits = (m_bytes_limit == 0 || m_byte_tokens >= std::min(double(piece_size), double(m_bytes_limit)))
+                && (m_lines_limit == 0 || m_line_tokens >= 1.0);
+        }
+        if (fits) {
+            if (m_bytes_limit != 0) {
+                // may go below 0 for a long line, which is then paid off before anything else fits
+                m_byte_tokens -= double(piece_size);
+            }
+            if (m_lines_limit != 0 && line_complete) {
+                m_line_tokens = std::max(0.0, m_line_tokens - 1.0);
+            }
+            write(pos, piece_size);
+            m_written_line_complete = line_complete;
+        } else {
+            if (!m_throttled) {
+                m_throttled = true;
+                m_throttle_dropped_bytes = 0;
+                m_throttle_dropped_lines = 0;
+                write_marker("output rate limit of " + std::to_string(m_bytes_limit) + " bytes/s, "
+                        + std::to_string(m_lines_limit) + " lines/s exceeded, dropping output",
+                    write);
+            }
+            m_last_drop = now;
+            m_dropped_bytes += piece_size;
+            m_throttle_dropped_bytes += piece_size;
+            m_dropped_lines += line_complete;
+            m_throttle_dropped_lines += line_complete;
+            m_dropping_line = !line_complete;
+        }
+        pos = piece_end;
+    }
+    update_rates(now, size, lines);
+}
+
+OutputBudget::Stats OutputBudget::stats() {
+    std::lock_guard guard(m_mutex);
+    Stats stats {};
+    // if nothing came in for a while, the last window's rate isn't current anymore
+    if (Clock::now() - m_window_start < std::chrono::seconds(2)) {
+        stats.bytes_per_sec = m_bytes_rate;
+        stats.lines_per_sec = m_lines_rate;
+    }
+    stats.dropped_bytes = m_dropped_bytes;
+    stats.dropped_lines = m_dropped_lines;
+    stats.throttled = m_throttled && Clock::now() - m_last_drop < std::chrono::seconds(1);
+    return stats;
+}
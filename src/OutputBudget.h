@@ -0,0 +1,73 @@
+#ifndef SERVERORGANIZER_OUTPUTBUDGET_H
+#define SERVERORGANIZER_OUTPUTBUDGET_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+// limits how much of a worker's output makes it into its log, with a token bucket
+// for bytes/s and one for lines/s, each allowing bursts of up to one second's worth.
+// a single line longer than a second's worth of bytes is still written once the bucket
+// is full, and paid off before anything else is.
+// output over the limit is counted and dropped instead of written, so a worker printing
+// in a tight loop can't saturate the disk for everyone else.
+class OutputBudget {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats {
+        // of the output the worker produced, not only what was written
+        double bytes_per_sec { 0 };
+        double lines_per_sec { 0 };
+        uint64_t dropped_bytes { 0 };
+        uint64_t dropped_lines { 0 };
+        bool throttled { false };
+    };
+
+    // 0 means unlimited
+    void set_limit(uint64_t bytes_per_sec, uint64_t lines_per_sec);
+    uint64_t bytes_limit();
+    uint64_t lines_limit();
+
+    // passes the lines of `data` which fit into the budget to `write`, and drops the rest.
+    // when dropping starts, and when nothing was dropped for a second after that,
+    // a marker line is passed to `write`, too.
+    void admit(const char* data, size_t size, const std::function<void(const char*, size_t)>& write);
+    // passes the marker to `write` if the worker went quiet after output was dropped,
+    // as admit() isn't called then. call it about once a second.
+    void tick(const std::function<void(const char*, size_t)>& write);
+    Stats stats();
+
+private:
+    // m_mutex has to be locked for these
+    void refill(Clock::time_point now);
+    void update_rates(Clock::time_point now, size_t bytes, size_t lines);
+    void resume_if_quiet(Clock::time_point now, const std::function<void(const char*, size_t)>& write);
+    void write_marker(const std::string& text, const std::function<void(const char*, size_t)>& write);
+
+    std::mutex m_mutex;
+    uint64_t m_bytes_limit { 0 };
+    uint64_t m_lines_limit { 0 };
+    double m_byte_tokens { 0 };
+    double m_line_tokens { 0 };
+    Clock::time_point m_last_refill { Clock::now() };
+    bool m_throttled { false };
+    Clock::time_point m_last_drop {};
+    // a line is either written or dropped as a whole, even if it arrives in pieces
+    bool m_dropping_line { false };
+    bool m_written_line_complete { true };
+    uint64_t m_dropped_bytes { 0 };
+    uint64_t m_dropped_lines { 0 };
+    // only since throttling started, for the marker when it stops
+    uint64_t m_throttle_dropped_bytes { 0 };
+    uint64_t m_throttle_dropped_lines { 0 };
+    Clock::time_point m_window_start { Clock::now() };
+    uint64_t m_window_bytes { 0 };
+    uint64_t m_window_lines { 0 };
+    double m_bytes_rate { 0 };
+    double m_lines_rate { 0 };
+};
+
+#endif //SERVERORGANIZER_OUTPUTBUDGET_H
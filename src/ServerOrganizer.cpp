@@ -1,9 +1,15 @@
 #include "ServerOrganizer.h"
+#include <cstdlib>
 #include <cstring>
 #include <fcntl.h>
+#include <filesystem>
 #include <iomanip>
+#include <limits>
 #include <sstream>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
+#include <tuple>
 
 static const std::string help_str = "list of all commands:\n"
                                     "* help - displays this help\n"
@@ -12,8 +18,106 @@ static const std::string help_str = "list of all commands:\n"
                                     "* register <identifier> <executable-path> [working-dir]- registers a new worker\n"
                                     "* remove <identifier> - removes the worker, SIGTERMs it if it's still running\n"
                                     "* autorestart <identifier> <on/off> - turns autorestart on crash/exit on or off\n"
-                                    "* query <identifer> <key> - querys the worker for a value. possible keys are `pid`, `status`, `autorestart`, `exited`, `signalled`. The return values for `query` are made to be easily machine-readable.\n"
-                                    "* restart <identifier> - restarts the given worker. Will SIGTERM/SIGKILL if the worker is still running.";
+                                    "* query <identifer> <key> - querys the worker for a value. possible keys are `pid`, `status`, `autorestart`, `exited`, `signalled`, `output_bytes_per_sec`, `output_lines_per_sec`, `dropped_bytes`, `dropped_lines`, `throttled`. The return values for `query` are made to be easily machine-readable.\n"
+                                    "* restart <identifier> - restarts the given worker. Will SIGTERM/SIGKILL if the worker is still running. If the worker has listen sockets, the new instance is started before the old one is stopped.\n"
+                                    "* listen <identifier> <port/unix-path> - opens a listening socket owned by the server, which is passed to the worker on (re)start as in systemd's LISTEN_FDS. Takes effect on the next (re)start.\n"
+                                    "* fds <identifier> - replies with the worker's listen sockets attached via SCM_RIGHTS\n"
+                                    "* outputlimit <identifier> <bytes/s> <lines/s> - limits how much of the worker's output is written to its log, 0 means unlimited. Output over the limit is dropped and counted, see `query`.\n"
+                                    "* events <identifier> [--since <time>] [--until <time>] - shows the worker's starts, exits and removals in the given time range\n"
+                                    "* uptime <identifier> [--since <time>] [--until <time>] - shows availability, MTBF and restart latencies of the worker, over the given time range\n"
+                                    "* logs <identifier> [--since <time>] [--until <time>] [--grep <pattern>] - shows the lines the worker printed in the given time range, optionally only those containing the pattern. Times are unix timestamps, YYYY-mm-ddTHH:MM:SS or HH:MM:SS (today).";
+
+
+namespace {
+// packs lines into as few messages as possible, only splitting lines longer than a message.
+// used by the commands which reply with a stream of messages.
+class MessageStream {
+public:
+    explicit MessageStream(int socket_fd)
+        : m_socket_fd(socket_fd) { }
+
+    // returns false once sending failed
+    bool write(std::string_view lines) {
+        while (!lines.empty() && m_ok) {
+            auto line_end = lines.find('\n');
+            auto line = lines.substr(0, line_end == std::string_view::npos ? lines.size() : line_end + 1);
+            if (m_chunk.size() + line.size() > CHUNK_SIZE && !m_chunk.empty()) {
+                flush();
+            }
+            auto part = line.substr(0, CHUNK_SIZE - m_chunk.size());
+            m_chunk.append(part);
+            lines.remove_prefix(part.size());
+        }
+        return m_ok;
+    }
+    // sends what's left, and the end marker
+    bool finish() {
+        if (!m_chunk.empty()) {
+            flush();
+        }
+        if (m_ok) {
+            Message msg = Message::from_string(Command::StreamEnd);
+            m_ok = send_message_with_fds(m_socket_fd, msg, {});
+        }
+        return m_ok;
+    }
+
+private:
+    static constexpr size_t CHUNK_SIZE = sizeof(Message::data) - 1;
+
+    void flush() {
+        Message msg = Message::from_string(m_chunk);
+        m_ok = m_ok && send_message_with_fds(m_socket_fd, msg, {});
+        m_chunk.clear();
+    }
+
+    int m_socket_fd;
+    std::string m_chunk;
+    bool m_ok { true };
+};
+}
+
+// parses `--since <time>`, `--until <time>` and, if `pattern` is given, `--grep <pattern>` from args[1..].
+// returns an error message, or an empty string on success.
+static std::string parse_range_args(const std::vector<std::string>& args, time_t& since, time_t& until, std::string* pattern) {
+    since = 0;
+    until = std::numeric_limits<time_t>::max();
+    for (size_t i = 1; i < args.size(); ++i) {
+        if (args.at(i) == "--since" && i + 1 < args.size()) {
+            since = parse_time_string(args.at(++i));
+        } else if (args.at(i) == "--until" && i + 1 < args.size()) {
+            until = parse_time_string(args.at(++i));
+        } else if (pattern && args.at(i) == "--grep" && i + 1 < args.size()) {
+            *pattern = args.at(++i);
+        } else {
+            return "argument \"" + args.at(i) + "\" unknown or missing parameters";
+        }
+        if (since < 0 || until < 0) {
+            return "invalid time \"" + args.at(i) + "\"";
+        }
+    }
+    return "";
+}
+
+// unix time to the journal's microseconds, clamped so that times far in the future can't overflow
+static int64_t to_event_time(time_t seconds) {
+    if (seconds >= std::numeric_limits<int64_t>::max() / 1000000) {
+        return std::numeric_limits<int64_t>::max();
+    }
+    return int64_t(seconds) * 1000000;
+}
+
+static std::string invalid_identifier_reply(const std::string& identifier) {
+    return "invalid identifier \"" + identifier + "\", it can't be empty, \".\", \"..\" or contain '/'";
+}
+
+// unix paths are compared normalized, ports by number
+static bool same_listen_address(const std::string& a, const std::string& b) {
+    if (a.starts_with('/') || b.starts_with('/')) {
+        return std::filesystem::path(a).lexically_normal() == std::filesystem::path(b).lexically_normal();
+    }
+    return std::strtol(a.c_str(), nullptr, 10) == std::strtol(b.c_str(), nullptr, 10);
+}
 
 std::string ServerOrganizer::command_help(const std::vector<std::string>& args) {
     if (args.empty()) {
@@ -46,9 +150,18 @@ std::string ServerOrganizer::command_register(const std::vector<std::string>& ar
     if (args.size() < 2) {
         return "invalid arguments, expected at least `identifier` and `executable-path` arguments";
     }
+    return register_worker(args, EventReason::Register);
+}
+
+std::string ServerOrganizer::register_worker(const std::vector<std::string>& args, EventReason reason, bool autorestart) {
+    // it's used as a directory name for the worker's logs
+    if (!is_valid_identifier(args.at(0))) {
+        return invalid_identifier_reply(args.at(0));
+    }
     if (m_monitors.contains(args.at(0))) {
         return "identifier \"" + args.at(0) + "\" is already used";
     }
+    return internal_register(args.at(0), args.at(1), args.size() == 3 ? args.at(2) : ".", autorestart, args, reason);
 }
 
 void ServerOrganizer::run_client(ServerOrganizer::Client&& client) {
@@ -66,11 +179,28 @@ void ServerOrganizer::run_client(ServerOrganizer::Client&& client) {
             error("error: received invalid size message: " + std::to_string(ret) + ", with error: " + std::string(std::strerror(errno)));
             break;
         }
-        Message response_message = process_message(Message::deserialize(data));
-        auto response = response_message.serialize();
-        ret = send(client.socket_fd, response.data(), response.size(), MSG_NOSIGNAL);
-        if (ret != response.size()) {
-            error("error during send: " + std::string(std::strerror(errno)));
+        Message request = Message::deserialize(data);
+        auto request_args = extract_args(request.to_string());
+        auto command = request.to_string().substr(0, request.to_string().find_first_of(' '));
+        if (m_stream_command_function_map.contains(command)) {
+            info("got command: \"" + request.to_string() + "\"");
+            if (!m_stream_command_function_map.at(command)(client.socket_fd, request_args)) {
+                break;
+            }
+            continue;
+        }
+        // `fds` is the only command which sends more than just the message
+        std::vector<int> fds;
+        if (request.to_string().starts_with("fds ") && request_args.size() == 1) {
+            std::lock_guard guard(m_monitors_mutex);
+            if (m_listen_sockets.contains(request_args.at(0))) {
+                for (const auto& sock : m_listen_sockets.at(request_args.at(0))) {
+                    fds.push_back(sock.fd);
+                }
+            }
+        }
+        Message response_message = process_message(std::move(request));
+        if (!send_message_with_fds(client.socket_fd, response_message, fds)) {
             break;
         }
         if (response_message.to_string() == Command::Detach) {
@@ -92,6 +222,8 @@ Message ServerOrganizer::process_message(Message&& msg) {
     if (str == "kickme") {
         response = Message::from_string(Command::Detach);
     } else if (m_command_function_map.contains(command)) {
+        // clients are served in parallel, and the restart and monitor threads change workers, too
+        std::lock_guard guard(m_monitors_mutex);
         response = Message::from_string(m_command_function_map.at(command)(extract_args(str)));
     } else {
         response = Message::from_string("unknown command");
@@ -99,28 +231,49 @@ Message ServerOrganizer::process_message(Message&& msg) {
     return response;
 }
 
-ServerOrganizer::ServerOrganizer() {
+ServerOrganizer::ServerOrganizer(ServerConfig config)
+    : m_config(std::move(config))
+    , m_status_table(m_config.status_table_name) {
     info("ServerOrganizer v1.0 Headless Server");
+    // logs left by earlier runs are compacted once, too
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(m_config.data_directory, ec)) {
+        if (entry.is_directory(ec)) {
+            m_unregistered_log_directories.insert(entry.path().string());
+        }
+    }
 }
 
 int ServerOrganizer::run() {
+    if (int pid = m_status_table.other_daemon_pid(); pid != 0) {
+        error("another headless server (pid " + std::to_string(pid) + ") is running with status table \"" + m_config.status_table_name
+            + "\". use --socket, --status-table and --data-dir to run several side by side.");
+        return -1;
+    }
     int fd = socket(AF_UNIX, SOCK_STREAM, 0);
     struct sockaddr_un addr {
         AF_UNIX, { }
     };
     info("socket created");
-    strncpy(addr.sun_path, SOCKET_FILENAME, sizeof(addr.sun_path) - 1);
+    strncpy(addr.sun_path, m_config.socket_path.c_str(), sizeof(addr.sun_path) - 1);
     int ret = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
     if (ret != 0) {
         error("failed to bind: " + std::string(std::strerror(errno)) + " - this is usually caused by the server not shutting down properly. use --clean to force start.");
         return -1;
     }
+    m_socket_bound = true;
     info("socket bound");
+    // clients which connect while another is being accepted wait in the backlog. the aggregator's
+    // connects are non-blocking, they fail right away if it's full.
+    if (listen(fd, SOMAXCONN) != 0) {
+        error("failed to listen: " + std::string(std::strerror(errno)));
+        return -1;
+    }
     std::thread restart_thread(&ServerOrganizer::restart_thread_main, this);
+    std::thread compaction_thread(&ServerOrganizer::compaction_thread_main, this);
     std::vector<std::thread> clients;
     while (!m_shutdown) {
         std::this_thread::sleep_for(std::chrono::milliseconds(50));
-        listen(fd, 1);
         Client client {};
         client.socket_fd = accept(fd, &client.sock_addr, &client.addrlen);
         if (client.socket_fd < 0) {
@@ -130,10 +283,19 @@ int ServerOrganizer::run() {
         t.detach();
     }
     restart_thread.join();
+    compaction_thread.join();
 }
 
 ServerOrganizer::~ServerOrganizer() {
-    unlink(SOCKET_FILENAME);
+    for (auto& pair : m_listen_sockets) {
+        for (auto& sock : pair.second) {
+            close_listen_socket(sock);
+        }
+    }
+    // the socket of another daemon stays
+    if (m_socket_bound) {
+        unlink(m_config.socket_path.c_str());
+    }
 }
 std::string ServerOrganizer::command_remove(const std::vector<std::string>& args) {
     if (args.size() != 1) {
@@ -141,9 +303,27 @@ std::string ServerOrganizer::command_remove(const std::vector<std::string>& args
     }
     auto name = args.at(0);
     if (m_monitors.contains(name)) {
-        bool sigtermed = m_monitors.at(name).terminate();
-        int status = m_monitors.at(name).status;
-        m_monitors.erase(name);
+        bool sigtermed = internal_remove(name);
+        if (auto journal = find_journal(name)) {
+            journal->record_remove();
+        }
+        m_status_table.remove(name);
+        if (m_listen_sockets.contains(name)) {
+            for (auto& sock : m_listen_sockets.at(name)) {
+                close_listen_socket(sock);
+            }
+            m_listen_sockets.erase(name);
+        }
+        {
+            // the segments stay on disk, and are picked up again if the worker is registered again
+            std::lock_guard guard(m_logs_mutex);
+            if (m_logs.contains(name)) {
+                m_unregistered_log_directories.insert(m_logs.at(name)->directory());
+            }
+            m_logs.erase(name);
+            m_output_budgets.erase(name);
+            m_journals.erase(name);
+        }
         if (sigtermed) {
             return "worker \"" + args.at(0) + "\" was still running, so it was terminated with SIGTERM/SIGKILL and then removed";
         } else {
@@ -174,18 +354,145 @@ std::string ServerOrganizer::command_autorestart(const std::vector<std::string>&
     }
 }
 void ServerOrganizer::restart_thread_main() {
+    auto last_publish = std::chrono::steady_clock::now();
     while (!m_shutdown) {
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        if (m_restart_queue.empty()) {
-            continue;
-        } else {
+        if (std::chrono::steady_clock::now() - last_publish >= std::chrono::seconds(1)) {
+            last_publish = std::chrono::steady_clock::now();
+            publish_output_samples();
+        }
+        // work through everything queued since the last wakeup, as a mass exit queues many restarts at once.
+        // the lock is taken per restart, so that clients aren't blocked for the whole batch.
+        while (true) {
+            std::lock_guard guard(m_monitors_mutex);
+            if (m_restart_queue.empty()) {
+                break;
+            }
             auto value = m_restart_queue.front();
             m_restart_queue.pop();
-            command_remove({ value.at(0) });
-            command_register(value);
+            auto& name = value.launch_args.at(0);
+            if (!m_monitors.contains(name)) {
+                // removed after the restart was queued
+                continue;
+            }
+            if (m_listen_sockets.contains(name) && !m_monitors.at(name).exited && !m_monitors.at(name).signalled) {
+                internal_handover_restart(value);
+            } else {
+                bool autorestart = m_monitors.at(name).autorestart;
+                // the old instance exits after the new one started, so the restart latency counts from stopping it
+                if (auto journal = find_journal(name)) {
+                    journal->record_stop_requested();
+                }
+                internal_remove(name);
+                register_worker(value.launch_args, value.reason, autorestart);
+            }
         }
+        // drop old instances which finished draining
+        std::lock_guard guard(m_monitors_mutex);
+        std::erase_if(m_draining, [](const auto& node) {
+            return node.mapped().exited || node.mapped().signalled;
+        });
     }
 }
+void ServerOrganizer::publish_output_samples() {
+    std::vector<std::tuple<std::string, std::shared_ptr<OutputBudget>, std::shared_ptr<WorkerLog>>> budgets;
+    {
+        std::lock_guard guard(m_logs_mutex);
+        for (const auto& [identifier, budget] : m_output_budgets) {
+            budgets.emplace_back(identifier, budget, m_logs.at(identifier));
+        }
+    }
+    for (const auto& [identifier, budget, log] : budgets) {
+        // a worker which went quiet while throttled still gets its log marked as resumed
+        budget->tick([&log](const char* data, size_t size) {
+            log->append(data, size);
+        });
+        auto stats = budget->stats();
+        m_status_table.update(identifier, [&](WorkerStatus& status) {
+            status.output_bytes_per_sec = uint64_t(stats.bytes_per_sec);
+            status.output_lines_per_sec = uint64_t(stats.lines_per_sec);
+            status.dropped_bytes = stats.dropped_bytes;
+            status.dropped_lines = stats.dropped_lines;
+        });
+    }
+}
+void ServerOrganizer::compaction_thread_main() {
+    // compressing must not take cpu or disk time away from the workers
+    setpriority(PRIO_PROCESS, gettid(), 19);
+    constexpr int IOPRIO_CLASS_IDLE = 3;
+    constexpr int IOPRIO_CLASS_SHIFT = 13;
+    constexpr int IOPRIO_WHO_PROCESS = 1;
+    syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+    auto last_run = std::chrono::steady_clock::now();
+    while (!m_shutdown) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (std::chrono::steady_clock::now() - last_run < std::chrono::seconds(10)) {
+            continue;
+        }
+        last_run = std::chrono::steady_clock::now();
+        std::vector<std::shared_ptr<WorkerLog>> logs;
+        {
+            std::lock_guard guard(m_logs_mutex);
+            for (const auto& pair : m_logs) {
+                logs.push_back(pair.second);
+            }
+            for (auto iter = m_unregistered_log_directories.begin(); iter != m_unregistered_log_directories.end();) {
+                logs.push_back(open_log(*iter));
+                // a removed worker's remaining processes may still write to it, then it's compacted again next time
+                if (logs.back().use_count() > 1) {
+                    ++iter;
+                } else {
+                    iter = m_unregistered_log_directories.erase(iter);
+                }
+            }
+        }
+        for (auto& log : logs) {
+            log->compact();
+        }
+    }
+}
+bool ServerOrganizer::internal_remove(const std::string& identifier) {
+    if (!m_monitors.contains(identifier)) {
+        return false;
+    }
+    auto& monitor = m_monitors.at(identifier);
+    monitor.autorestart = false;
+    bool sigtermed = monitor.terminate();
+    // its thread uses the Monitor until the process is gone, so it drains like after a handover
+    m_draining.push_back(m_monitors.extract(identifier));
+    return sigtermed;
+}
+void ServerOrganizer::internal_handover_restart(const RestartRequest& request) {
+    auto& name = request.launch_args.at(0);
+    // take the old instance out of the map without moving it, so its thread stays valid,
+    // then start the new one. both accept on the same sockets until the old one exits.
+    auto old = m_monitors.extract(name);
+    bool autorestart = old.mapped().autorestart;
+    old.mapped().autorestart = false;
+    register_worker(request.launch_args, EventReason::Handover, autorestart);
+    if (!m_monitors.contains(name) || m_monitors.at(name).start_failed) {
+        // the old instance keeps serving, a failed handover must not turn into an outage
+        const int old_pid = old.mapped().pid;
+        warn("handover of \"" + name + "\" failed, pid " + std::to_string(old_pid) + " keeps running");
+        if (m_monitors.contains(name)) {
+            m_monitors.at(name).autorestart = false;
+            m_draining.push_back(m_monitors.extract(name));
+        }
+        old.mapped().autorestart = autorestart;
+        m_monitors.insert(std::move(old));
+        m_status_table.update(name, [&](WorkerStatus& status) {
+            status.state = WorkerState::Running;
+            status.pid = old_pid;
+            status.status = 0;
+            status.last_change = event_time_now();
+        });
+        return;
+    }
+    info("handing over \"" + name + "\" from pid " + std::to_string(old.mapped().pid) + " to pid " + std::to_string(m_monitors.at(name).pid));
+    // SIGTERM lets the old instance drain its in-flight connections
+    old.mapped().terminate();
+    m_draining.push_back(std::move(old));
+}
 std::string ServerOrganizer::command_query(const std::vector<std::string>& args) {
     if (args.size() != 2) {
         return "ERROR - invalid arguments";
@@ -205,6 +512,21 @@ std::string ServerOrganizer::command_query(const std::vector<std::string>& args)
         return monitor.signalled ? "true" : "false";
     } else if (key == "autorestart") {
         return monitor.autorestart ? "true" : "false";
+    } else if (key == "output_bytes_per_sec" || key == "output_lines_per_sec" || key == "dropped_bytes"
+        || key == "dropped_lines" || key == "throttled") {
+        auto budget = find_output_budget(args.at(0));
+        auto stats = budget ? budget->stats() : OutputBudget::Stats {};
+        if (key == "output_bytes_per_sec") {
+            return std::to_string(uint64_t(stats.bytes_per_sec));
+        } else if (key == "output_lines_per_sec") {
+            return std::to_string(uint64_t(stats.lines_per_sec));
+        } else if (key == "dropped_bytes") {
+            return std::to_string(stats.dropped_bytes);
+        } else if (key == "dropped_lines") {
+            return std::to_string(stats.dropped_lines);
+        } else {
+            return stats.throttled ? "true" : "false";
+        }
     } else {
         return "ERROR - unknown key";
     }
@@ -236,95 +558,367 @@ std::string ServerOrganizer::command_restart(const std::vector<std::string>& arg
     }
     auto name = args.at(0);
     if (m_monitors.contains(name)) {
-        m_restart_queue.push(m_monitors.at(name).launch_args);
+        m_restart_queue.push({ m_monitors.at(name).launch_args, EventReason::Restart });
         return "queued \"" + name + "\" to be restarted";
     } else {
         return "worker \"" + name + "\" unknown";
     }
 }
-std::string ServerOrganizer::internal_register(const std::string& identifier, const std::string& executable, const std::string& working_dir, bool autorestart, const std::vector<std::string>& args) {
+std::string ServerOrganizer::command_listen(const std::vector<std::string>& args) {
+    if (args.size() != 2) {
+        return "`listen` takes arguments `identifier` and `port/unix-path`";
+    }
+    auto name = args.at(0);
+    // sockets are only closed on `remove`, so they can't be opened for a worker which can't be removed
+    if (!m_monitors.contains(name)) {
+        return "worker \"" + name + "\" unknown";
+    }
+    if (same_listen_address(args.at(1), m_config.socket_path)) {
+        return "\"" + args.at(1) + "\" is the server's own socket";
+    }
+    for (const auto& pair : m_listen_sockets) {
+        for (const auto& sock : pair.second) {
+            if (same_listen_address(sock.address, args.at(1))) {
+                return "worker \"" + pair.first + "\" already listens on \"" + args.at(1) + "\"";
+            }
+        }
+    }
+    auto& sockets = m_listen_sockets[name];
+    int fd = create_listen_socket(args.at(1));
+    if (fd < 0) {
+        if (sockets.empty()) {
+            m_listen_sockets.erase(name);
+        }
+        return "failed to listen on \"" + args.at(1) + "\", see server log";
+    }
+    sockets.push_back(ListenSocket { fd, args.at(1) });
+    info("listening on \"" + args.at(1) + "\" for \"" + name + "\"");
+    return "listening on \"" + args.at(1) + "\" for \"" + name + "\", passed as fd " + std::to_string(LISTEN_FDS_START + int(sockets.size()) - 1) + " on the next (re)start";
+}
+std::string ServerOrganizer::command_fds(const std::vector<std::string>& args) {
+    if (args.size() != 1) {
+        return "`fds` only takes one argument `identifier`";
+    }
+    if (!m_listen_sockets.contains(args.at(0))) {
+        return "worker \"" + args.at(0) + "\" has no listen sockets";
+    }
+    // the fds themselves are attached by run_client, this only names them in order
+    std::string names;
+    for (const auto& sock : m_listen_sockets.at(args.at(0))) {
+        names += (names.empty() ? "" : ":") + sock.address;
+    }
+    return "LISTEN_FDNAMES=" + names;
+}
+std::string ServerOrganizer::command_outputlimit(const std::vector<std::string>& args) {
+    if (args.size() != 3) {
+        return "`outputlimit` takes arguments `identifier`, `bytes/s` and `lines/s`";
+    }
+    auto budget = find_output_budget(args.at(0));
+    if (!budget) {
+        return "worker \"" + args.at(0) + "\" unknown";
+    }
+    uint64_t bytes_per_sec, lines_per_sec;
+    // stoull happily wraps "-1" around
+    if (args.at(1).starts_with('-') || args.at(2).starts_with('-')) {
+        return "`bytes/s` and `lines/s` have to be numbers, 0 means unlimited";
+    }
+    try {
+        bytes_per_sec = std::stoull(args.at(1));
+        lines_per_sec = std::stoull(args.at(2));
+    } catch (const std::exception&) {
+        return "`bytes/s` and `lines/s` have to be numbers, 0 means unlimited";
+    }
+    budget->set_limit(bytes_per_sec, lines_per_sec);
+    if (bytes_per_sec == 0 && lines_per_sec == 0) {
+        return "output of \"" + args.at(0) + "\" is not limited anymore";
+    }
+    return "output of \"" + args.at(0) + "\" limited to " + args.at(1) + " bytes/s, " + args.at(2) + " lines/s (0 = unlimited)";
+}
+std::string ServerOrganizer::command_uptime(const std::vector<std::string>& args) {
+    if (args.empty()) {
+        return "usage: 'uptime <identifier> [--since <time>] [--until <time>]'";
+    }
+    if (!is_valid_identifier(args.at(0))) {
+        return invalid_identifier_reply(args.at(0));
+    }
+    // read straight from disk, so the history of removed workers is still available
+    const std::string journal_path = event_journal_path(worker_directory(m_config.data_directory, args.at(0)));
+    struct stat st { };
+    if (stat(journal_path.c_str(), &st) != 0) {
+        return "no events recorded for worker \"" + args.at(0) + "\"";
+    }
+    time_t since, until;
+    auto error_str = parse_range_args(args, since, until, nullptr);
+    if (!error_str.empty()) {
+        return error_str;
+    }
+    EventJournalReader reader(journal_path);
+    auto stats = compute_uptime(reader.records(), to_event_time(since), to_event_time(until));
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(3);
+    ss << "availability " << stats.availability() * 100.0 << "% over " << format_duration(stats.observed)
+       << " (up " << format_duration(stats.uptime) << ")\n";
+    ss << stats.starts << " starts, " << stats.restarts << " restarts, " << stats.crashes << " crashes, MTBF "
+       << (stats.mtbf() < 0 ? "n/a" : format_duration(stats.mtbf())) << "\n";
+    if (stats.restart_latencies.empty()) {
+        ss << "restart latency n/a";
+    } else {
+        ss << "restart latency p50 " << format_duration(stats.restart_latency_percentile(0.5))
+           << ", p90 " << format_duration(stats.restart_latency_percentile(0.9))
+           << ", p99 " << format_duration(stats.restart_latency_percentile(0.99))
+           << ", max " << format_duration(stats.restart_latencies.back());
+    }
+    return ss.str();
+}
+std::shared_ptr<EventJournal> ServerOrganizer::find_journal(const std::string& identifier) {
+    std::lock_guard guard(m_logs_mutex);
+    if (m_journals.contains(identifier)) {
+        return m_journals.at(identifier);
+    }
+    return nullptr;
+}
+std::shared_ptr<WorkerLog> ServerOrganizer::open_log(const std::string& directory) {
+    if (auto log = m_open_logs[directory].lock()) {
+        return log;
+    }
+    auto log = std::make_shared<WorkerLog>(directory, m_config.log_policy);
+    m_open_logs[directory] = log;
+    // drop the entries of logs nobody uses anymore
+    std::erase_if(m_open_logs, [](const auto& pair) {
+        return pair.second.expired();
+    });
+    return log;
+}
+std::shared_ptr<OutputBudget> ServerOrganizer::find_output_budget(const std::string& identifier) {
+    std::lock_guard guard(m_logs_mutex);
+    if (m_output_budgets.contains(identifier)) {
+        return m_output_budgets.at(identifier);
+    }
+    return nullptr;
+}
+bool ServerOrganizer::stream_logs(int socket_fd, const std::vector<std::string>& args) {
+    MessageStream stream(socket_fd);
+    if (args.empty()) {
+        return stream.write("usage: 'logs <identifier> [--since <time>] [--until <time>] [--grep <pattern>]'") && stream.finish();
+    }
+    if (!is_valid_identifier(args.at(0))) {
+        return stream.write(invalid_identifier_reply(args.at(0))) && stream.finish();
+    }
+    std::shared_ptr<WorkerLog> log;
+    {
+        std::lock_guard guard(m_logs_mutex);
+        const std::string directory = worker_directory(m_config.data_directory, args.at(0));
+        std::error_code ec;
+        if (m_logs.contains(args.at(0))) {
+            log = m_logs.at(args.at(0));
+        } else if (std::filesystem::is_directory(directory, ec)) {
+            // a removed worker's log is kept on disk, so its output around a crash can still be searched
+            log = open_log(directory);
+        }
+    }
+    if (!log) {
+        return stream.write("worker \"" + args.at(0) + "\" unknown") && stream.finish();
+    }
+    time_t since, until;
+    std::string pattern;
+    auto error_str = parse_range_args(args, since, until, &pattern);
+    if (!error_str.empty()) {
+        return stream.write(error_str) && stream.finish();
+    }
+    bool found = log->search(since, until, pattern, [&](std::string_view lines) {
+        return stream.write(lines);
+    });
+    if (!found) {
+        stream.write("\nfailed to read log, see server log");
+    }
+    return stream.finish();
+}
+bool ServerOrganizer::stream_events(int socket_fd, const std::vector<std::string>& args) {
+    MessageStream stream(socket_fd);
+    if (args.empty()) {
+        return stream.write("usage: 'events <identifier> [--since <time>] [--until <time>]'") && stream.finish();
+    }
+    if (!is_valid_identifier(args.at(0))) {
+        return stream.write(invalid_identifier_reply(args.at(0))) && stream.finish();
+    }
+    // read straight from disk, so the history of removed workers is still available
+    const std::string journal_path = event_journal_path(worker_directory(m_config.data_directory, args.at(0)));
+    struct stat st { };
+    if (stat(journal_path.c_str(), &st) != 0) {
+        return stream.write("no events recorded for worker \"" + args.at(0) + "\"") && stream.finish();
+    }
+    time_t since, until;
+    auto error_str = parse_range_args(args, since, until, nullptr);
+    if (!error_str.empty()) {
+        return stream.write(error_str) && stream.finish();
+    }
+    EventJournalReader reader(journal_path);
+    // timestamps are wall clock time, which can step backwards, so the records aren't necessarily
+    // sorted. at 32 bytes each, checking all of them is cheap.
+    const int64_t since_us = to_event_time(since);
+    for (const auto& record : reader.records()) {
+        if (record.timestamp < since_us || record.timestamp / 1000000 > until) {
+            continue;
+        }
+        if (!stream.write(event_to_string(record) + "\n")) {
+            return false;
+        }
+    }
+    return stream.finish();
+}
+std::string ServerOrganizer::internal_register(const std::string& identifier, const std::string& executable, const std::string& working_dir, bool autorestart, const std::vector<std::string>& args, EventReason reason) {
+    struct stat st { };
+    std::string start_error;
+    // first ensure that the directory exists
+    if (stat(m_config.data_directory.c_str(), &st) != 0) {
+        int ret = mkdir(m_config.data_directory.c_str(), 0700);
+        if (ret != 0) {
+            error("mkdir failed: " + std::string(strerror(errno)));
+            return "failed to create \"" + m_config.data_directory + "\", see server log";
+        }
+    }
+    // the log is kept across restarts, so that old and new instance can share it during a handover,
+    // and crash output isn't lost. its segments are written to <data directory>/<identifier>/
+    std::shared_ptr<WorkerLog> log;
+    std::shared_ptr<OutputBudget> budget;
+    std::shared_ptr<EventJournal> journal;
+    {
+        std::lock_guard guard(m_logs_mutex);
+        if (!m_logs.contains(args.at(0))) {
+            const std::string directory = worker_directory(m_config.data_directory, args.at(0));
+            m_logs.insert({ args.at(0), open_log(directory) });
+            m_unregistered_log_directories.erase(directory);
+            m_output_budgets.insert({ args.at(0), std::make_shared<OutputBudget>() });
+            // the journal lives next to the log segments, created by WorkerLog
+            m_journals.insert({ args.at(0), std::make_shared<EventJournal>(directory) });
+        }
+        log = m_logs.at(args.at(0));
+        budget = m_output_budgets.at(args.at(0));
+        journal = m_journals.at(args.at(0));
+    }
+    // the worker's stdout and stderr go into this pipe, which the daemon reads, limits and writes to the log.
+    // O_CLOEXEC so that other workers don't inherit the write end and keep it open
+    int output_pipe[2];
+    if (pipe2(output_pipe, O_CLOEXEC) != 0) {
+        error("pipe2 failed: " + std::string(strerror(errno)));
+        return "failed to create output pipe, see server log";
+    }
+    // the child writes its errno into this if it fails to exec. a successful exec closes it through
+    // O_CLOEXEC, so reading EOF means the worker's executable is running.
+    int exec_pipe[2];
+    if (pipe2(exec_pipe, O_CLOEXEC) != 0) {
+        error("pipe2 failed: " + std::string(strerror(errno)));
+        close(output_pipe[0]);
+        close(output_pipe[1]);
+        return "failed to create exec status pipe, see server log";
+    }
     pid_t pid = fork();
     if (pid == 0) {
         // child
+        auto fail = [&](int code) {
+            int err = errno;
+            write(exec_pipe[1], &err, sizeof(err));
+            exit(code);
+        };
         if (args.size() == 3) {
             int ret = chdir(args.at(2).c_str());
             if (ret != 0) {
-                exit(55);
+                fail(55);
             }
         }
-
-        constexpr char temp_dir[] = "/tmp/ServerOrganizer";
-        // write this file to /tmp/ServerOrganizer/<identifier>.log
-        const std::string file_path = std::string(temp_dir) + "/" + args.at(0) + ".log";
-        struct stat st { };
-        // first ensure that the directory exists
-        if (stat(temp_dir, &st) != 0) {
-            int ret = mkdir(temp_dir, 0700);
-            if (ret != 0) {
-                error("mkdir failed: " + std::string(strerror(errno)));
-                exit(-1);
-            }
-        } else {
-            // directory exists, so let's see if the file exists
-            // and delete it if it does
-            if (stat(file_path.c_str(), &st) != 0) {
-                int ret = unlink(file_path.c_str());
-                if (ret != 0) {
-                    // this isn't fatal, don't exit
-                    warn("unlink failed: " + std::string(strerror(errno)));
-                }
-            }
-        }
-        // now we grab a file descriptor to this file
-        int fd = open(file_path.c_str(), O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
-        if (fd < 0) {
-            error("open failed: " + std::string(strerror(errno)));
-            exit(-1);
-        }
-        // replace stdout's filedescriptor with the file's one
-        int ret = dup2(fd, STDOUT_FILENO);
+        // replace stdout's filedescriptor with the pipe's one
+        int ret = dup2(output_pipe[1], STDOUT_FILENO);
         if (ret == -1) {
             error("dup2 for stdout failed: " + std::string(strerror(errno)));
-            exit(-1);
+            fail(-1);
         }
-        ret = dup2(fd, STDERR_FILENO);
+        ret = dup2(output_pipe[1], STDERR_FILENO);
         if (ret == -1) {
             error("dup2 for stderr failed: " + std::string(strerror(errno)));
-            exit(-1);
+            fail(-1);
         }
-        ret = close(fd);
-        if (ret != 0) {
-            // not fatal, don't handle at all since we don't have stdout anymore
+        if (m_listen_sockets.contains(args.at(0)) && !pass_listen_sockets_to_child(m_listen_sockets.at(args.at(0)))) {
+            error("passing listen sockets failed: " + std::string(strerror(errno)));
+            fail(-1);
         }
         auto name = args.at(1).c_str();
         execl(name, name, nullptr);
-        exit(0);
+        fail(127);
     } else {
         // still in the parent
+        close(output_pipe[1]);
+        close(exec_pipe[1]);
+        int child_errno = 0;
+        ssize_t n;
+        while ((n = read(exec_pipe[0], &child_errno, sizeof(child_errno))) < 0 && errno == EINTR) { }
+        close(exec_pipe[0]);
+        start_error = n == sizeof(child_errno) ? std::string(strerror(child_errno)) : "";
+        std::thread([log, budget, fd = output_pipe[0]] {
+            std::array<char, 64 * 1024> buffer {};
+            while (true) {
+                auto ret = read(fd, buffer.data(), buffer.size());
+                if (ret < 0 && errno == EINTR) {
+                    continue;
+                } else if (ret <= 0) {
+                    // EOF, the worker (and all its children) closed the pipe
+                    break;
+                }
+                budget->admit(buffer.data(), ret, [&log](const char* data, size_t size) {
+                    log->append(data, size);
+                });
+            }
+            close(fd);
+        }).detach();
         auto [iter_value_pair, replaced] = m_monitors.insert({ args.at(0), Monitor {} });
         auto& monitor = iter_value_pair->second;
         monitor.pid = pid;
+        monitor.autorestart = autorestart;
+        monitor.start_failed = !start_error.empty();
         monitor.launch_args = args;
-        monitor.thread = std::thread([&] {
-            while (true) {
-                waitpid(pid, &monitor.status, 0);
-                if (WIFEXITED(monitor.status)) {
-                    monitor.set_status(WEXITSTATUS(monitor.status));
-                    break;
-                } else if (WIFSIGNALED(monitor.status)) {
-                    monitor.set_signalled(WTERMSIG(monitor.status));
-                    break;
-                } else if (WIFSTOPPED(monitor.status) || WIFCONTINUED(monitor.status)) {
-                    // we dont care
-                    continue;
-                }
+        journal->record_start(pid, reason);
+        auto set_started = [&](WorkerStatus& status) {
+            status.state = WorkerState::Running;
+            status.pid = pid;
+            status.status = 0;
+            status.last_change = event_time_now();
+            if (reason != EventReason::Register) {
+                status.restarts += 1;
+            }
+        };
+        m_status_table.update(args.at(0), set_started, true);
+        monitor.thread = std::thread([&monitor, this, pid, journal] {
+            // wait without reaping, so the pid can't be reused while a command may still signal it
+            siginfo_t siginfo {};
+            while (waitid(P_PID, pid, &siginfo, WEXITED | WNOWAIT) != 0 && errno == EINTR) { }
+            // a drained Monitor is freed once it's marked as exited, so this is the last time it's touched
+            std::lock_guard guard(m_monitors_mutex);
+            int wstatus = 0;
+            waitpid(pid, &wstatus, 0);
+            if (WIFEXITED(wstatus)) {
+                monitor.set_status(WEXITSTATUS(wstatus));
+            } else {
+                monitor.set_signalled(WTERMSIG(wstatus));
             }
+            auto ran_for = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - monitor.started);
+            journal->record_exit(pid, monitor.signalled, monitor.status, monitor.exit_requested, ran_for.count());
+            m_status_table.update(monitor.launch_args.at(0), [&](WorkerStatus& status) {
+                // after a handover, the old instance exiting doesn't change the worker's state
+                if (status.pid == pid) {
+                    status.state = monitor.signalled ? WorkerState::Signalled : WorkerState::Exited;
+                    status.status = monitor.status;
+                    status.last_change = event_time_now();
+                }
+            });
             if (monitor.autorestart) {
-                m_restart_queue.push(monitor.launch_args);
+                m_restart_queue.push({ monitor.launch_args, EventReason::Autorestart });
             }
         });
         monitor.thread.detach();
     }
+    if (!start_error.empty()) {
+        error("starting \"" + args.at(1) + "\" as " + args.at(0) + " failed: " + start_error);
+        return "registered \"" + args.at(0) + "\", but starting it failed: " + start_error;
+    }
     info("started new process (pid " + std::to_string(pid) + ") as " + args.at(0));
     // parent
     return "registered \"" + args.at(0) + "\"";
@@ -341,6 +935,7 @@ void Monitor::set_signalled(int _signal) {
 }
 bool Monitor::terminate() {
     if (!exited && !signalled) {
+        exit_requested = true;
         int ret = kill(pid, SIGTERM);
         if (ret != 0) {
             error("kill(" + std::to_string(pid) + ", SIGTERM) failed: " + std::string(std::strerror(errno)));
@@ -2,9 +2,19 @@
 #define SERVERORGANIZER_SERVERORGANIZER_H
 
 #include "Common.h"
+#include "EventJournal.h"
+#include "ListenSocket.h"
+#include "OutputBudget.h"
+#include "StatusTableWriter.h"
+#include "WorkerLog.h"
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <queue>
+#include <set>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -19,6 +29,11 @@ struct Monitor {
     int status { 0 };
     int pid { 0 };
     bool autorestart { false };
+    // set by terminate(), so the exit isn't counted as a crash
+    bool exit_requested { false };
+    // set if the worker failed before or at exec, it exits right away then
+    bool start_failed { false };
+    std::chrono::steady_clock::time_point started { std::chrono::steady_clock::now() };
     // keep this around for autorestart
     std::vector<std::string> launch_args;
     void set_status(int _status);
@@ -27,6 +42,21 @@ struct Monitor {
     bool terminate();
 };
 
+// several headless servers can run side by side, as long as these paths differ. if only the socket
+// is given, the status table and data directory are derived from it, see server.cpp.
+struct ServerConfig {
+    std::string socket_path { SOCKET_FILENAME };
+    std::string status_table_name { STATUS_TABLE_NAME };
+    // the workers' log segments and event journals, see worker_directory()
+    std::string data_directory { WORKER_DIRECTORY_ROOT };
+    WorkerLog::Policy log_policy {};
+};
+
+struct RestartRequest {
+    std::vector<std::string> launch_args;
+    EventReason reason;
+};
+
 class ServerOrganizer {
 public:
     struct Client {
@@ -37,7 +67,7 @@ public:
         std::string to_string() const;
     };
 
-    ServerOrganizer();
+    explicit ServerOrganizer(ServerConfig config = {});
     ~ServerOrganizer();
 
     std::string command_help(const std::vector<std::string>& args);
@@ -48,17 +78,39 @@ public:
     std::string command_query(const std::vector<std::string>& args);
     std::string command_list(const std::vector<std::string>& args);
     std::string command_restart(const std::vector<std::string>& args);
+    std::string command_listen(const std::vector<std::string>& args);
+    std::string command_fds(const std::vector<std::string>& args);
+    std::string command_outputlimit(const std::vector<std::string>& args);
+    std::string command_uptime(const std::vector<std::string>& args);
 
     Message process_message(Message&& msg);
 
     int run();
     void run_client(Client&& client);
+    // these reply with any number of messages followed by Command::StreamEnd, see m_stream_command_function_map
+    bool stream_logs(int socket_fd, const std::vector<std::string>& args);
+    bool stream_events(int socket_fd, const std::vector<std::string>& args);
 
 private:
     void restart_thread_main();
-    std::string internal_register(const std::string& identifier, const std::string& executable, const std::string& working_dir, bool autorestart, const std::vector<std::string>& args);
+    void compaction_thread_main();
+    // refreshes the output samples of all workers in the status table, and marks the logs of
+    // workers which are not throttled anymore
+    void publish_output_samples();
+    std::shared_ptr<OutputBudget> find_output_budget(const std::string& identifier);
+    std::shared_ptr<EventJournal> find_journal(const std::string& identifier);
+    // returns the WorkerLog of `directory`, which is shared by everyone still using it. m_logs_mutex has to be locked
+    std::shared_ptr<WorkerLog> open_log(const std::string& directory);
+    // the functions below have to be called with m_monitors_mutex locked
+    std::string register_worker(const std::vector<std::string>& args, EventReason reason, bool autorestart = false);
+    // removes the monitor, but keeps the worker's listen sockets open
+    bool internal_remove(const std::string& identifier);
+    // starts a new instance on the same listen sockets before stopping the old one
+    void internal_handover_restart(const RestartRequest& request);
+    std::string internal_register(const std::string& identifier, const std::string& executable, const std::string& working_dir, bool autorestart, const std::vector<std::string>& args, EventReason reason);
 
     std::atomic_bool m_shutdown = false;
+    bool m_socket_bound { false };
     std::map<std::string, std::function<std::string(const std::vector<std::string>&)>> m_command_function_map = {
         { "help", { [this](const auto& vec) -> std::string { return command_help(vec); } } },
         { "list", { [this](const auto& vec) -> std::string { return command_list(vec); } } },
@@ -68,9 +120,39 @@ private:
         { "autorestart", { [this](const auto& vec) -> std::string { return command_autorestart(vec); } } },
         { "query", { [this](const auto& vec) -> std::string { return command_query(vec); } } },
         { "restart", { [this](const auto& vec) -> std::string { return command_restart(vec); } } },
+        { "listen", { [this](const auto& vec) -> std::string { return command_listen(vec); } } },
+        { "fds", { [this](const auto& vec) -> std::string { return command_fds(vec); } } },
+        { "outputlimit", { [this](const auto& vec) -> std::string { return command_outputlimit(vec); } } },
+        { "uptime", { [this](const auto& vec) -> std::string { return command_uptime(vec); } } },
+    };
+    std::map<std::string, std::function<bool(int, const std::vector<std::string>&)>> m_stream_command_function_map = {
+        { "logs", { [this](int fd, const auto& vec) -> bool { return stream_logs(fd, vec); } } },
+        { "events", { [this](int fd, const auto& vec) -> bool { return stream_events(fd, vec); } } },
     };
     std::map<std::string, Monitor> m_monitors;
-    std::queue<std::vector<std::string>> m_restart_queue;
+    // owned by the daemon and kept across restarts, only closed on `remove`
+    std::map<std::string, std::vector<ListenSocket>> m_listen_sockets;
+    // shared with the threads reading the workers' output, kept across restarts
+    std::map<std::string, std::shared_ptr<WorkerLog>> m_logs;
+    // same as m_logs, so limits and drop counters survive restarts
+    std::map<std::string, std::shared_ptr<OutputBudget>> m_output_budgets;
+    std::map<std::string, std::shared_ptr<EventJournal>> m_journals;
+    // every WorkerLog still in use, by directory. a removed worker's output may still be written to
+    // its log, so registering it again has to continue with the same WorkerLog.
+    std::map<std::string, std::weak_ptr<WorkerLog>> m_open_logs;
+    // logs without a registered worker, removed or from earlier runs, which still need compaction
+    std::set<std::string> m_unregistered_log_directories;
+    // guards m_logs, m_output_budgets, m_journals, m_open_logs and m_unregistered_log_directories
+    std::mutex m_logs_mutex;
+    ServerConfig m_config;
+    // old instances which were replaced by a handover restart or removed, and are still shutting down.
+    // node handles keep the Monitor at the same address, which its thread relies on.
+    std::vector<decltype(m_monitors)::node_type> m_draining;
+    std::queue<RestartRequest> m_restart_queue;
+    // guards m_monitors, m_listen_sockets, m_draining and m_restart_queue. held while a command runs,
+    // by the restart thread while it restarts a worker, and by a monitor's thread when its worker exits.
+    std::mutex m_monitors_mutex;
+    StatusTableWriter m_status_table;
 };
 
 #endif //SERVERORGANIZER_SERVERORGANIZER_H
@@ -0,0 +1,161 @@
+#ifndef SERVERORGANIZER_STATUSTABLE_H
+#define SERVERORGANIZER_STATUSTABLE_H
+
+// the layout of the worker status table which the headless server publishes in POSIX shared memory,
+// and a reader for it. header-only and without dependencies on the rest of ServerOrganizer, so
+// monitoring tools can include just this file to read the status of all workers without a socket
+// round-trip or any syscalls per read. link with -lrt on glibc older than 2.34.
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+static constexpr auto STATUS_TABLE_NAME = "/ServerOrganizer_status_1_0";
+static constexpr uint32_t STATUS_TABLE_MAGIC = 0x54534f53; // "SOST"
+static constexpr uint32_t STATUS_TABLE_VERSION = 1;
+static constexpr uint32_t STATUS_TABLE_SLOTS = 4096;
+
+// the table of a headless server started with --socket but without --status-table
+inline std::string status_table_name_for_socket(const std::string& socket_path) {
+    std::string name = STATUS_TABLE_NAME;
+    for (char c : socket_path) {
+        name += c == '/' ? '_' : c;
+    }
+    return name;
+}
+
+enum class WorkerState : uint32_t {
+    Empty = 0,
+    Running = 1,
+    Exited = 2,
+    Signalled = 3,
+};
+
+struct WorkerStatus {
+    char identifier[64];
+    WorkerState state;
+    int32_t pid;
+    // exit code or signal number
+    int32_t status;
+    uint32_t restarts;
+    // unix time in microseconds of the last state change
+    int64_t last_change;
+    // the output samples, see OutputBudget
+    uint64_t output_bytes_per_sec;
+    uint64_t output_lines_per_sec;
+    uint64_t dropped_bytes;
+    uint64_t dropped_lines;
+};
+
+// each slot is guarded by a seqlock: the writer makes `sequence` odd, writes, and makes it even again.
+// a reader retries if the sequence was odd or changed while it copied the status.
+struct alignas(64) StatusSlot {
+    std::atomic<uint32_t> sequence;
+    WorkerStatus status;
+};
+
+struct alignas(64) StatusTableHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    int32_t daemon_pid;
+    // bumped whenever a slot is taken or freed
+    std::atomic<uint32_t> generation;
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "the seqlock has to work across processes");
+
+static constexpr size_t STATUS_TABLE_SIZE = sizeof(StatusTableHeader) + sizeof(StatusSlot) * STATUS_TABLE_SLOTS;
+
+class StatusTableReader {
+public:
+    explicit StatusTableReader(const std::string& name = STATUS_TABLE_NAME) {
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st { };
+        if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(StatusTableHeader)) {
+            void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (map != MAP_FAILED) {
+                m_map = map;
+                m_size = st.st_size;
+            }
+        }
+        close(fd);
+        // refuse tables from other versions, or which aren't fully set up yet
+        if (m_map && (header()->magic != STATUS_TABLE_MAGIC || header()->version != STATUS_TABLE_VERSION
+                || header()->slot_size != sizeof(StatusSlot)
+                || m_size < sizeof(StatusTableHeader) + sizeof(StatusSlot) * size_t(header()->slot_count))) {
+            munmap(m_map, m_size);
+            m_map = nullptr;
+        }
+    }
+    ~StatusTableReader() {
+        if (m_map) {
+            munmap(m_map, m_size);
+        }
+    }
+    StatusTableReader(const StatusTableReader&) = delete;
+    StatusTableReader& operator=(const StatusTableReader&) = delete;
+
+    bool is_open() const { return m_map != nullptr; }
+    uint32_t slot_count() const { return m_map ? header()->slot_count : 0; }
+    int daemon_pid() const { return m_map ? header()->daemon_pid : 0; }
+    uint32_t generation() const { return m_map ? header()->generation.load(std::memory_order_acquire) : 0; }
+
+    // copies a consistent snapshot of slot `index` into `out`. returns false if the slot is empty, or if
+    // no consistent copy could be made, e.g. because the daemon died in the middle of writing the slot.
+    bool read(uint32_t index, WorkerStatus& out) const {
+        if (index >= slot_count()) {
+            return false;
+        }
+        const StatusSlot& slot = slots()[index];
+        for (int attempt = 0; attempt < READ_ATTEMPTS; ++attempt) {
+            const uint32_t before = slot.sequence.load(std::memory_order_acquire);
+            if (before & 1) {
+                // being written right now
+                continue;
+            }
+            std::memcpy(&out, &slot.status, sizeof(out));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) == before) {
+                return out.state != WorkerState::Empty;
+            }
+        }
+        return false;
+    }
+
+    // all workers which are currently in the table
+    std::vector<WorkerStatus> snapshot() const {
+        std::vector<WorkerStatus> result;
+        WorkerStatus status {};
+        for (uint32_t i = 0; i < slot_count(); ++i) {
+            if (read(i, status)) {
+                result.push_back(status);
+            }
+        }
+        return result;
+    }
+
+private:
+    // a write takes a single memcpy, so this is only exhausted if the writer is gone mid-write
+    static constexpr int READ_ATTEMPTS = 100000;
+
+    const StatusTableHeader* header() const { return static_cast<const StatusTableHeader*>(m_map); }
+    const StatusSlot* slots() const {
+        return reinterpret_cast<const StatusSlot*>(static_cast<const char*>(m_map) + sizeof(StatusTableHeader));
+    }
+
+    void* m_map { nullptr };
+    size_t m_size { 0 };
+};
+
+#endif //SERVERORGANIZER_STATUSTABLE_H
@@ -0,0 +1,119 @@
+#include "StatusTableWriter.h"
+#include "Common.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <new>
+
+StatusTableWriter::StatusTableWriter(const std::string& name)
+    : m_name(name)
+    , m_statuses(STATUS_TABLE_SLOTS) {
+    // a table of a daemon which is still running is left alone
+    if (StatusTableReader existing(name); existing.is_open()) {
+        const int pid = existing.daemon_pid();
+        if (pid > 0 && pid != getpid() && (kill(pid, 0) == 0 || errno == EPERM)) {
+            error("status table \"" + name + "\" belongs to the running headless server with pid " + std::to_string(pid));
+            m_other_daemon_pid = pid;
+            return;
+        }
+    }
+    // one left behind by a daemon which didn't shut down properly is recreated, readers which
+    // still have the old one mapped just see it stop changing
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd < 0) {
+        // EEXIST if another daemon created it just now
+        error("shm_open \"" + name + "\" failed: " + std::string(std::strerror(errno)));
+        return;
+    }
+    m_created = true;
+    if (ftruncate(fd, STATUS_TABLE_SIZE) != 0) {
+        error("ftruncate of \"" + name + "\" failed: " + std::string(std::strerror(errno)));
+        close(fd);
+        return;
+    }
+    void* map = mmap(nullptr, STATUS_TABLE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        error("mmap of \"" + name + "\" failed: " + std::string(std::strerror(errno)));
+        return;
+    }
+    m_map = map;
+    // the memory is zeroed, which is an empty slot with sequence 0
+    m_slots = reinterpret_cast<StatusSlot*>(static_cast<char*>(map) + sizeof(StatusTableHeader));
+    for (uint32_t i = 0; i < STATUS_TABLE_SLOTS; ++i) {
+        new (&m_slots[i].sequence) std::atomic<uint32_t>(0);
+    }
+    for (uint32_t i = STATUS_TABLE_SLOTS; i > 0; --i) {
+        m_free_slots.push_back(i - 1);
+    }
+    m_header = new (map) StatusTableHeader {};
+    m_header->version = STATUS_TABLE_VERSION;
+    m_header->slot_count = STATUS_TABLE_SLOTS;
+    m_header->slot_size = sizeof(StatusSlot);
+    m_header->daemon_pid = getpid();
+    // readers check the magic last, so it's written last
+    std::atomic_thread_fence(std::memory_order_release);
+    m_header->magic = STATUS_TABLE_MAGIC;
+    info("publishing worker status in shared memory \"" + name + "\"");
+}
+
+StatusTableWriter::~StatusTableWriter() {
+    if (m_map) {
+        munmap(m_map, STATUS_TABLE_SIZE);
+    }
+    if (m_created) {
+        shm_unlink(m_name.c_str());
+    }
+}
+
+void StatusTableWriter::publish(uint32_t index) {
+    StatusSlot& slot = m_slots[index];
+    const uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(&slot.status, &m_statuses.at(index), sizeof(WorkerStatus));
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void StatusTableWriter::update(const std::string& identifier, const std::function<void(WorkerStatus&)>& change, bool create) {
+    if (!m_map) {
+        return;
+    }
+    std::lock_guard guard(m_mutex);
+    uint32_t index;
+    if (auto iter = m_slot_indices.find(identifier); iter != m_slot_indices.end()) {
+        index = iter->second;
+    } else if (!create) {
+        return;
+    } else if (m_free_slots.empty()) {
+        warn("status table is full, \"" + identifier + "\" is not published");
+        return;
+    } else {
+        index = m_free_slots.back();
+        m_free_slots.pop_back();
+        m_slot_indices.insert({ identifier, index });
+        m_statuses.at(index) = WorkerStatus {};
+        std::copy_n(identifier.begin(), std::min(identifier.size(), sizeof(WorkerStatus::identifier) - 1), m_statuses.at(index).identifier);
+        m_header->generation.fetch_add(1, std::memory_order_release);
+    }
+    change(m_statuses.at(index));
+    publish(index);
+}
+
+void StatusTableWriter::remove(const std::string& identifier) {
+    if (!m_map) {
+        return;
+    }
+    std::lock_guard guard(m_mutex);
+    auto iter = m_slot_indices.find(identifier);
+    if (iter == m_slot_indices.end()) {
+        return;
+    }
+    const uint32_t index = iter->second;
+    m_statuses.at(index) = WorkerStatus {};
+    publish(index);
+    m_slot_indices.erase(iter);
+    m_free_slots.push_back(index);
+    m_header->generation.fetch_add(1, std::memory_order_release);
+}
@@ -0,0 +1,45 @@
+#ifndef SERVERORGANIZER_STATUSTABLEWRITER_H
+#define SERVERORGANIZER_STATUSTABLEWRITER_H
+
+#include "StatusTable.h"
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// the daemon's side of the shared memory status table, see StatusTable.h for the layout and reader.
+class StatusTableWriter {
+public:
+    explicit StatusTableWriter(const std::string& name = STATUS_TABLE_NAME);
+    ~StatusTableWriter();
+
+    bool is_open() const { return m_map != nullptr; }
+    // the pid of the running daemon which already publishes a table under this name, or 0
+    int other_daemon_pid() const { return m_other_daemon_pid; }
+
+    // applies `change` to the worker's status and publishes it. if the worker has no slot,
+    // it takes a free one if `create` is set, and does nothing otherwise.
+    void update(const std::string& identifier, const std::function<void(WorkerStatus&)>& change, bool create = false);
+    // frees the worker's slot
+    void remove(const std::string& identifier);
+
+private:
+    // m_mutex has to be locked
+    void publish(uint32_t index);
+
+    std::string m_name;
+    // only a table this daemon created is removed again
+    bool m_created { false };
+    int m_other_daemon_pid { 0 };
+    void* m_map { nullptr };
+    StatusTableHeader* m_header { nullptr };
+    StatusSlot* m_slots { nullptr };
+    std::mutex m_mutex;
+    std::map<std::string, uint32_t> m_slot_indices;
+    std::vector<uint32_t> m_free_slots;
+    // what was last published, so changes don't have to read back from the shared memory
+    std::vector<WorkerStatus> m_statuses;
+};
+
+#endif //SERVERORGANIZER_STATUSTABLEWRITER_H
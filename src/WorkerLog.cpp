@@ -0,0 +1,465 @@
+#include "WorkerLog.h"
+#include "Common.h"
+#include "Lz4.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <optional>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// compressed segments are a header followed by independently compressed blocks,
+// so a search only has to decompress the blocks overlapping its range
+static constexpr char COMPRESSED_MAGIC[4] = { 'S', 'O', 'L', 'Z' };
+static constexpr size_t COMPRESSED_BLOCK_SIZE = 1024 * 1024;
+
+struct CompressedHeader {
+    char magic[4];
+    uint32_t block_size;
+    uint64_t size;
+};
+
+struct CompressedBlockHeader {
+    uint32_t size;
+    // equal to `size` if the block is stored uncompressed
+    uint32_t compressed_size;
+};
+
+static bool read_all(int fd, void* data, size_t size, off_t offset) {
+    size_t done = 0;
+    while (done < size) {
+        auto ret = pread(fd, static_cast<char*>(data) + done, size - done, offset + done);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        } else if (ret <= 0) {
+            return false;
+        }
+        done += ret;
+    }
+    return true;
+}
+
+static bool write_all(int fd, const void* data, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        auto ret = write(fd, static_cast<const char*>(data) + done, size - done);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        } else if (ret < 0) {
+            return false;
+        }
+        done += ret;
+    }
+    return true;
+}
+
+// calls `callback` with the lines in [begin, end) or only those containing `pattern`.
+// returns false if `callback` asked to stop.
+static bool scan_lines(const char* begin, const char* end, const std::string& pattern, const std::function<bool(std::string_view)>& callback) {
+    if (pattern.empty()) {
+        return callback({ begin, size_t(end - begin) });
+    }
+    // memmem and memchr are vectorized in glibc, so we search the whole range for the
+    // pattern and only look for line boundaries around matches
+    const char* pos = begin;
+    while (pos < end) {
+        auto match = static_cast<const char*>(memmem(pos, end - pos, pattern.data(), pattern.size()));
+        if (!match) {
+            break;
+        }
+        auto line_begin = static_cast<const char*>(memrchr(pos, '\n', match - pos));
+        line_begin = line_begin ? line_begin + 1 : pos;
+        auto line_end = static_cast<const char*>(std::memchr(match, '\n', end - match));
+        line_end = line_end ? line_end + 1 : end;
+        if (!callback({ line_begin, size_t(line_end - line_begin) })) {
+            return false;
+        }
+        pos = line_end;
+    }
+    return true;
+}
+
+WorkerLog::WorkerLog(const std::string& directory, Policy policy)
+    : m_directory(directory)
+    , m_policy(policy) {
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    if (ec) {
+        error("creating \"" + directory + "\" failed: " + ec.message());
+        return;
+    }
+    // pick up what previous runs left behind, so history survives restarts of the worker and the daemon
+    uint64_t next_number = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+        auto name = entry.path().filename().string();
+        if (name.ends_with(".tmp")) {
+            // a compaction which didn't finish
+            std::filesystem::remove(entry.path(), ec);
+            continue;
+        }
+        Segment segment {};
+        if (name.ends_with(".log.lz4")) {
+            segment.compressed = true;
+        } else if (!name.ends_with(".log")) {
+            continue;
+        }
+        try {
+            segment.number = std::stoull(name.substr(0, name.find('.')));
+        } catch (const std::exception&) {
+            continue;
+        }
+        segment.disk_size = entry.file_size(ec);
+        if (segment.compressed) {
+            // if the daemon died after compressing but before removing the original, both exist
+            Segment original {};
+            original.number = segment.number;
+            if (std::filesystem::exists(segment_path(original), ec)) {
+                std::filesystem::remove(entry.path(), ec);
+                continue;
+            }
+            int fd = open(entry.path().c_str(), O_RDONLY | O_CLOEXEC);
+            CompressedHeader header {};
+            bool ok = fd >= 0 && read_all(fd, &header, sizeof(header), 0) && std::memcmp(header.magic, COMPRESSED_MAGIC, sizeof(COMPRESSED_MAGIC)) == 0;
+            if (fd >= 0) {
+                close(fd);
+            }
+            if (!ok) {
+                warn("ignoring invalid log segment \"" + entry.path().string() + "\"");
+                continue;
+            }
+            segment.size = header.size;
+        } else if (segment.disk_size == 0) {
+            // an active segment nothing was written to
+            std::filesystem::remove(entry.path(), ec);
+            std::filesystem::remove(index_path(segment), ec);
+            continue;
+        } else {
+            segment.size = segment.disk_size;
+        }
+        int index_fd = open(index_path(segment).c_str(), O_RDONLY | O_CLOEXEC);
+        if (index_fd >= 0) {
+            struct stat st { };
+            fstat(index_fd, &st);
+            segment.index.resize(st.st_size / sizeof(IndexEntry));
+            if (!read_all(index_fd, segment.index.data(), segment.index.size() * sizeof(IndexEntry), 0)) {
+                segment.index.clear();
+            }
+            close(index_fd);
+        }
+        next_number = std::max(next_number, segment.number + 1);
+        m_sealed.push_back(std::move(segment));
+    }
+    std::sort(m_sealed.begin(), m_sealed.end(), [](const Segment& a, const Segment& b) {
+        return a.number < b.number;
+    });
+    open_active_segment(next_number);
+}
+
+WorkerLog::~WorkerLog() {
+    if (m_fd >= 0) {
+        close(m_fd);
+        // don't leave an empty active segment behind, the next WorkerLog starts its own
+        if (m_active.size == 0) {
+            unlink(segment_path(m_active).c_str());
+            unlink(index_path(m_active).c_str());
+        }
+    }
+    if (m_index_fd >= 0) {
+        close(m_index_fd);
+    }
+}
+
+std::string WorkerLog::segment_path(const Segment& segment) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llu.log", static_cast<unsigned long long>(segment.number));
+    return m_directory + "/" + name + (segment.compressed ? ".lz4" : "");
+}
+
+std::string WorkerLog::index_path(const Segment& segment) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llu.idx", static_cast<unsigned long long>(segment.number));
+    return m_directory + "/" + name;
+}
+
+bool WorkerLog::open_active_segment(uint64_t number) {
+    m_active = Segment {};
+    m_active.number = number;
+    m_active.created = time(nullptr);
+    // an existing segment is never overwritten, whatever left it there
+    while ((m_fd = open(segment_path(m_active).c_str(), O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR)) < 0 && errno == EEXIST) {
+        warn("log segment \"" + segment_path(m_active) + "\" already exists, skipping it");
+        m_active.number += 1;
+    }
+    if (m_fd < 0) {
+        error("open \"" + segment_path(m_active) + "\" failed: " + std::string(std::strerror(errno)));
+        return false;
+    }
+    m_index_fd = open(index_path(m_active).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (m_index_fd < 0) {
+        error("open \"" + index_path(m_active) + "\" failed: " + std::string(std::strerror(errno)));
+    }
+    return true;
+}
+
+void WorkerLog::seal_active_segment() {
+    close(m_fd);
+    m_fd = -1;
+    if (m_index_fd >= 0) {
+        close(m_index_fd);
+        m_index_fd = -1;
+    }
+    const uint64_t next_number = m_active.number + 1;
+    m_sealed.push_back(std::move(m_active));
+    open_active_segment(next_number);
+    // a fast writer seals segments faster than compact() runs, so the budget is kept here, too
+    enforce_retention();
+}
+
+void WorkerLog::enforce_retention() {
+    size_t total = m_active.disk_size;
+    for (const auto& segment : m_sealed) {
+        total += segment.disk_size;
+    }
+    while (total > m_policy.retention_size && !m_sealed.empty()) {
+        const auto& oldest = m_sealed.front();
+        info("log retention: deleting \"" + segment_path(oldest) + "\"");
+        unlink(segment_path(oldest).c_str());
+        unlink(index_path(oldest).c_str());
+        total -= oldest.disk_size;
+        m_sealed.pop_front();
+    }
+}
+
+void WorkerLog::append(const char* data, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    time_t now = time(nullptr);
+    std::lock_guard guard(m_mutex);
+    if (m_fd >= 0 && m_active.size > 0
+        && (m_active.size >= m_policy.segment_size || now - m_active.created >= m_policy.segment_age)) {
+        seal_active_segment();
+    }
+    if (m_fd < 0) {
+        return;
+    }
+    if (m_active.index.empty() || m_active.index.back().time != now) {
+        // index entries have to point at the start of a line, so if we're in the middle
+        // of one, the entry starts after the next newline. if there is none, the next
+        // append in this second tries again.
+        std::optional<IndexEntry> entry;
+        if (m_at_line_start) {
+            entry = IndexEntry { now, int64_t(m_active.size) };
+        } else if (auto newline = static_cast<const char*>(std::memchr(data, '\n', size)); newline && newline + 1 != data + size) {
+            entry = IndexEntry { now, int64_t(m_active.size + (newline + 1 - data)) };
+        }
+        if (entry) {
+            m_active.index.push_back(*entry);
+            if (m_index_fd >= 0) {
+                write_all(m_index_fd, &*entry, sizeof(*entry));
+            }
+        }
+    }
+    if (!write_all(m_fd, data, size)) {
+        error("write to \"" + segment_path(m_active) + "\" failed: " + std::string(std::strerror(errno)));
+        return;
+    }
+    m_active.size += size;
+    m_active.disk_size = m_active.size;
+    m_at_line_start = data[size - 1] == '\n';
+}
+
+bool WorkerLog::search(time_t since, time_t until, const std::string& pattern, const std::function<bool(std::string_view)>& callback) {
+    struct Range {
+        int fd;
+        bool compressed;
+        size_t begin;
+        size_t end;
+    };
+    std::vector<Range> ranges;
+    {
+        std::lock_guard guard(m_mutex);
+        auto add_range = [&](const Segment& segment) {
+            auto first = std::lower_bound(segment.index.begin(), segment.index.end(), since, [](const IndexEntry& entry, time_t t) {
+                return entry.time < t;
+            });
+            if (first == segment.index.end()) {
+                return;
+            }
+            auto last = std::upper_bound(first, segment.index.end(), until, [](time_t t, const IndexEntry& entry) {
+                return t < entry.time;
+            });
+            size_t begin = first->offset;
+            size_t end = last == segment.index.end() ? segment.size : last->offset;
+            if (begin >= end) {
+                return;
+            }
+            // opened while locked, so compact() can replace or delete the file without breaking this search
+            int fd = open(segment_path(segment).c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                error("open \"" + segment_path(segment) + "\" failed: " + std::string(std::strerror(errno)));
+                return;
+            }
+            ranges.push_back({ fd, segment.compressed, begin, end });
+        };
+        for (const auto& segment : m_sealed) {
+            add_range(segment);
+        }
+        add_range(m_active);
+    }
+    bool ok = true;
+    bool keep_going = true;
+    for (const auto& range : ranges) {
+        if (!keep_going) {
+            break;
+        } else if (range.compressed) {
+            // decompress only the blocks overlapping the range into one buffer
+            std::string data;
+            size_t data_begin = 0;
+            off_t pos = sizeof(CompressedHeader);
+            size_t block_begin = 0;
+            std::vector<char> compressed;
+            CompressedBlockHeader block {};
+            while (block_begin < range.end && read_all(range.fd, &block, sizeof(block), pos)) {
+                pos += sizeof(block);
+                if (block_begin + block.size > range.begin) {
+                    if (data.empty()) {
+                        data_begin = block_begin;
+                    }
+                    compressed.resize(block.compressed_size);
+                    auto offset = data.size();
+                    data.resize(offset + block.size);
+                    if (!read_all(range.fd, compressed.data(), compressed.size(), pos)) {
+                        ok = false;
+                        break;
+                    } else if (block.compressed_size == block.size) {
+                        std::memcpy(data.data() + offset, compressed.data(), block.size);
+                    } else if (lz4_decompress(compressed.data(), compressed.size(), data.data() + offset, block.size) != long(block.size)) {
+                        error("corrupt block in log segment in \"" + m_directory + "\"");
+                        ok = false;
+                        break;
+                    }
+                }
+                pos += block.compressed_size;
+                block_begin += block.size;
+            }
+            if (ok && !data.empty()) {
+                const size_t end = std::min(range.end - data_begin, data.size());
+                keep_going = scan_lines(data.data() + (range.begin - data_begin), data.data() + end, pattern, callback);
+            }
+        } else {
+            // mmap wants a page aligned offset, so map a little more and skip it
+            const size_t page_size = sysconf(_SC_PAGESIZE);
+            const size_t map_offset = range.begin - range.begin % page_size;
+            const size_t map_size = range.end - map_offset;
+            void* map = mmap(nullptr, map_size, PROT_READ, MAP_SHARED, range.fd, off_t(map_offset));
+            if (map == MAP_FAILED) {
+                error("mmap of a log segment in \"" + m_directory + "\" failed: " + std::string(std::strerror(errno)));
+                ok = false;
+            } else {
+                madvise(map, map_size, MADV_SEQUENTIAL);
+                const char* begin = static_cast<const char*>(map) + (range.begin - map_offset);
+                keep_going = scan_lines(begin, static_cast<const char*>(map) + map_size, pattern, callback);
+                munmap(map, map_size);
+            }
+        }
+    }
+    for (const auto& range : ranges) {
+        close(range.fd);
+    }
+    return ok;
+}
+
+bool WorkerLog::compress_segment(const Segment& segment) {
+    const std::string path = segment_path(segment);
+    Segment compressed_segment = segment;
+    compressed_segment.compressed = true;
+    const std::string compressed_path = segment_path(compressed_segment);
+    const std::string temp_path = compressed_path + ".tmp";
+    int in_fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in_fd < 0) {
+        error("open \"" + path + "\" failed: " + std::string(std::strerror(errno)));
+        return false;
+    }
+    int out_fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (out_fd < 0) {
+        error("open \"" + temp_path + "\" failed: " + std::string(std::strerror(errno)));
+        close(in_fd);
+        return false;
+    }
+    CompressedHeader header {};
+    std::copy(std::begin(COMPRESSED_MAGIC), std::end(COMPRESSED_MAGIC), header.magic);
+    header.block_size = COMPRESSED_BLOCK_SIZE;
+    header.size = segment.size;
+    bool ok = write_all(out_fd, &header, sizeof(header));
+    std::vector<char> block(COMPRESSED_BLOCK_SIZE);
+    std::vector<char> compressed(lz4_compress_bound(COMPRESSED_BLOCK_SIZE));
+    for (size_t offset = 0; ok && offset < segment.size; offset += COMPRESSED_BLOCK_SIZE) {
+        const size_t size = std::min(COMPRESSED_BLOCK_SIZE, segment.size - offset);
+        if (!read_all(in_fd, block.data(), size, off_t(offset))) {
+            ok = false;
+            break;
+        }
+        size_t compressed_size = lz4_compress(block.data(), size, compressed.data(), compressed.size());
+        const char* data = compressed.data();
+        if (compressed_size >= size) {
+            // incompressible, store it as-is
+            compressed_size = size;
+            data = block.data();
+        }
+        CompressedBlockHeader block_header { uint32_t(size), uint32_t(compressed_size) };
+        ok = write_all(out_fd, &block_header, sizeof(block_header)) && write_all(out_fd, data, compressed_size);
+    }
+    close(in_fd);
+    ok = ok && fsync(out_fd) == 0;
+    close(out_fd);
+    if (!ok || rename(temp_path.c_str(), compressed_path.c_str()) != 0) {
+        error("compressing \"" + path + "\" failed: " + std::string(std::strerror(errno)));
+        unlink(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+void WorkerLog::compact() {
+    std::lock_guard compact_guard(m_compact_mutex);
+    std::vector<Segment> to_compress;
+    {
+        std::lock_guard guard(m_mutex);
+        // a worker which stopped printing should still get its old output compressed
+        if (m_fd >= 0 && m_active.size > 0 && time(nullptr) - m_active.created >= m_policy.segment_age) {
+            seal_active_segment();
+        }
+        for (const auto& segment : m_sealed) {
+            if (!segment.compressed && segment.size > 0) {
+                to_compress.push_back(segment);
+            }
+        }
+    }
+    // sealed segments don't change anymore, so they can be compressed without holding the lock
+    for (const auto& segment : to_compress) {
+        if (!compress_segment(segment)) {
+            continue;
+        }
+        Segment compressed_segment = segment;
+        compressed_segment.compressed = true;
+        std::error_code ec;
+        const size_t disk_size = std::filesystem::file_size(segment_path(compressed_segment), ec);
+        std::lock_guard guard(m_mutex);
+        auto iter = std::find_if(m_sealed.begin(), m_sealed.end(), [&](const Segment& s) {
+            return s.number == segment.number;
+        });
+        if (iter != m_sealed.end()) {
+            iter->compressed = true;
+            iter->disk_size = disk_size;
+        } else {
+            // deleted by retention while it was being compressed
+            unlink(segment_path(compressed_segment).c_str());
+        }
+        unlink(segment_path(segment).c_str());
+    }
+    std::lock_guard guard(m_mutex);
+    enforce_retention();
+}
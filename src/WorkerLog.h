@@ -0,0 +1,86 @@
+#ifndef SERVERORGANIZER_WORKERLOG_H
+#define SERVERORGANIZER_WORKERLOG_H
+
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <vector>
+
+// a worker's log, written by the daemon from the worker's stdout/stderr pipe.
+// it's stored as a directory of append-only segments: the active one is written to,
+// and gets sealed once it's too big or too old. sealed segments are compressed and
+// the oldest ones are deleted by compact(), which runs on a background thread.
+// every segment has a sparse index of when which byte offset was written,
+// so time ranges can be found without reading the whole log.
+class WorkerLog {
+public:
+    struct Policy {
+        size_t segment_size { 64 * 1024 * 1024 };
+        time_t segment_age { 60 * 60 };
+        // for all segments of this worker together, as they are on disk
+        size_t retention_size { 1024 * 1024 * 1024 };
+    };
+
+    // picks up segments which are already in `directory`, and starts a new active one.
+    // there must only be one WorkerLog per directory at a time, two would write to the same segments.
+    WorkerLog(const std::string& directory, Policy policy);
+    ~WorkerLog();
+
+    bool is_open() const { return m_fd >= 0; }
+    const std::string& directory() const { return m_directory; }
+
+    void append(const char* data, size_t size);
+    // calls `callback` with whole lines which were written between `since` and `until` (both inclusive),
+    // only those containing `pattern` if it's not empty. stops early if `callback` returns false.
+    // returns false if a segment could not be read.
+    bool search(time_t since, time_t until, const std::string& pattern, const std::function<bool(std::string_view)>& callback);
+    // seals the active segment if it's too old, compresses sealed segments, and deletes
+    // the oldest ones until the log fits into the retention size. slow, call it in the background.
+    void compact();
+
+private:
+    // on disk as-is in the .idx file next to each segment
+    struct IndexEntry {
+        int64_t time;
+        // always the start of a line
+        int64_t offset;
+    };
+    struct Segment {
+        uint64_t number { 0 };
+        bool compressed { false };
+        // uncompressed
+        size_t size { 0 };
+        size_t disk_size { 0 };
+        time_t created { 0 };
+        // at most one entry per second, sorted by time and offset
+        std::vector<IndexEntry> index;
+    };
+
+    std::string segment_path(const Segment& segment) const;
+    std::string index_path(const Segment& segment) const;
+    bool open_active_segment(uint64_t number);
+    // m_mutex has to be locked
+    void seal_active_segment();
+    // deletes the oldest sealed segments until the log fits into the retention size. m_mutex has to be locked
+    void enforce_retention();
+    bool compress_segment(const Segment& segment);
+
+    std::string m_directory;
+    Policy m_policy;
+    std::mutex m_mutex;
+    // serializes compact() calls, without blocking appends while compressing
+    std::mutex m_compact_mutex;
+    int m_fd { -1 };
+    int m_index_fd { -1 };
+    bool m_at_line_start { true };
+    Segment m_active;
+    // oldest first
+    std::deque<Segment> m_sealed;
+};
+
+#endif //SERVERORGANIZER_WORKERLOG_H
@@ -0,0 +1,90 @@
+#include "Aggregator.h"
+#include "Common.h"
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+void info(const std::string& str) {
+    std::cout << "[" << get_date_time_string() << "] [INFO] " << str << std::endl;
+}
+
+void warn(const std::string& str) {
+    std::cout << "[" << get_date_time_string() << "] [WARNING] " << str << std::endl;
+}
+
+void error(const std::string& str) {
+    std::cout << "[" << get_date_time_string() << "] [ERROR] " << str << std::endl;
+}
+
+static std::string socket_path = AGGREGATOR_SOCKET_FILENAME;
+
+static void signal_handler(int sig) {
+    switch (sig) {
+    case SIGTERM:
+        info("exiting through SIGTERM");
+        unlink(socket_path.c_str());
+        exit(0);
+    case SIGINT:
+        info("exiting through SIGINT");
+        unlink(socket_path.c_str());
+        exit(0);
+    default:
+        return;
+    }
+}
+
+// aggregator, fans commands out to several headless servers
+int main(int argc, char* argv[]) {
+    bool clean = false;
+    std::vector<Aggregator::Instance> instances;
+    long timeout_ms = 1000;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--clean") {
+            clean = true;
+        } else if (arg == "--socket" && argc > i + 1) {
+            socket_path = std::filesystem::absolute(argv[i + 1]);
+            i += 1;
+        } else if (arg == "--instance" && argc > i + 1) {
+            // name=socket-path
+            std::string value = argv[i + 1];
+            auto eq = value.find('=');
+            if (eq == std::string::npos || eq == 0 || eq + 1 == value.size() || value.find('/') < eq) {
+                std::cout << "--instance expects `name=socket-path`, got \"" + value + "\"" << std::endl;
+                return -1;
+            }
+            auto name = value.substr(0, eq);
+            if (std::any_of(instances.begin(), instances.end(), [&](const auto& instance) { return instance.name == name; })) {
+                std::cout << "instance \"" + name + "\" given twice" << std::endl;
+                return -1;
+            }
+            instances.push_back({ name, std::filesystem::absolute(value.substr(eq + 1)) });
+            i += 1;
+        } else if (arg == "--timeout-ms" && argc > i + 1) {
+            timeout_ms = std::stol(argv[i + 1]);
+            i += 1;
+        } else {
+            std::cout << "argument \"" + arg + "\" unknown or missing parameters" << std::endl;
+            return -1;
+        }
+    }
+    if (instances.empty()) {
+        std::cout << "no instances given, use --instance name=socket-path for each headless server" << std::endl;
+        return -1;
+    }
+    signal(SIGTERM, signal_handler);
+    signal(SIGINT, signal_handler);
+    if (clean) {
+        info("cleaning up previous runs");
+        struct stat st { };
+        if (stat(socket_path.c_str(), &st) == 0 && unlink(socket_path.c_str()) != 0) {
+            error("unlinking \"" + socket_path + "\" failed: " + std::string(std::strerror(errno)));
+        }
+    }
+    Aggregator aggregator(socket_path, std::move(instances), std::chrono::milliseconds(timeout_ms));
+    return aggregator.run();
+}
@@ -0,0 +1,165 @@
+#include "Common.h"
+#include "WorkerLog.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+
+// benchmark for `logs` searches over large worker logs. writes a log of the given size through WorkerLog,
+// like the daemon does with a worker's output, then times a full scan against searches narrowed by
+// --since/--until, with and without --grep. with --compress, the same searches run again after the
+// segments were compressed. the page cache is warm for all of them, so this measures cpu, not disk.
+
+void info(const std::string& str) {
+    std::cout << "[" << get_time_string() << "] [INFO] " << str << std::endl;
+}
+
+void warn(const std::string& str) {
+    std::cout << "[" << get_time_string() << "] [WARNING] " << str << std::endl;
+}
+
+void error(const std::string& str) {
+    std::cout << "[" << get_time_string() << "] [ERROR] " << str << std::endl;
+}
+
+namespace {
+struct Options {
+    size_t size_mib { 4096 };
+    size_t line_size { 120 };
+    // one line in this many contains the grep pattern
+    size_t needle_every { 100000 };
+    bool compress { false };
+    bool keep { false };
+    std::string directory;
+};
+
+struct SearchResult {
+    size_t lines { 0 };
+    size_t bytes { 0 };
+    double seconds { 0 };
+};
+
+SearchResult timed_search(WorkerLog& log, time_t since, time_t until, const std::string& pattern) {
+    SearchResult result {};
+    auto start = std::chrono::steady_clock::now();
+    bool ok = log.search(since, until, pattern, [&](std::string_view lines) {
+        result.bytes += lines.size();
+        result.lines += std::count(lines.begin(), lines.end(), '\n');
+        return true;
+    });
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!ok) {
+        error("search failed");
+    }
+    return result;
+}
+
+std::string format_result(const std::string& name, const SearchResult& result, size_t log_size) {
+    std::stringstream ss;
+    ss.precision(3);
+    ss << std::fixed << name << ": " << result.seconds * 1000.0 << "ms, " << result.lines << " lines, "
+       << double(result.bytes) / 1024.0 / 1024.0 << " MiB returned, "
+       << double(log_size) / 1024.0 / 1024.0 / 1024.0 / result.seconds << " GiB/s of log";
+    return ss.str();
+}
+
+void run_searches(WorkerLog& log, time_t first, time_t last, size_t log_size, const std::string& label) {
+    const time_t middle = first + (last - first) / 2;
+    const time_t max = std::numeric_limits<time_t>::max();
+    info(format_result(label + " full scan --grep", timed_search(log, 0, max, "needle"), log_size));
+    info(format_result(label + " 1s range", timed_search(log, middle, middle, ""), log_size));
+    info(format_result(label + " 1s range --grep", timed_search(log, middle, middle, "needle"), log_size));
+    info(format_result(label + " last 1s --grep", timed_search(log, last, max, "needle"), log_size));
+}
+}
+
+int main(int argc, char* argv[]) {
+    Options options {};
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--compress") {
+            options.compress = true;
+        } else if (arg == "--keep") {
+            options.keep = true;
+        } else if (arg == "--size-mib" && argc > i + 1) {
+            options.size_mib = std::stoull(argv[++i]);
+        } else if (arg == "--line-size" && argc > i + 1) {
+            options.line_size = std::max<size_t>(32, std::stoull(argv[++i]));
+        } else if (arg == "--directory" && argc > i + 1) {
+            options.directory = argv[++i];
+        } else {
+            std::cout << "argument \"" + arg + "\" unknown or missing parameters" << std::endl;
+            return -1;
+        }
+    }
+    if (options.directory.empty()) {
+        char directory_template[] = "/tmp/ServerOrganizer_logbench.XXXXXX";
+        if (!mkdtemp(directory_template)) {
+            std::cout << "mkdtemp failed: " << std::strerror(errno) << std::endl;
+            return -1;
+        }
+        options.directory = directory_template;
+    }
+    const size_t log_size = options.size_mib * 1024 * 1024;
+    // retention and age never kick in, compact() only compresses
+    WorkerLog::Policy policy {};
+    policy.retention_size = std::numeric_limits<size_t>::max();
+    const std::string log_directory = options.directory + "/log";
+    auto log = std::make_unique<WorkerLog>(log_directory, policy);
+    if (!log->is_open()) {
+        return 1;
+    }
+
+    // written in pipe-sized chunks, like the daemon's output reader does
+    info("writing " + std::to_string(options.size_mib) + " MiB to \"" + options.directory + "\"");
+    std::string chunk;
+    size_t written = 0;
+    size_t line_number = 0;
+    const time_t first = time(nullptr);
+    auto start = std::chrono::steady_clock::now();
+    while (written < log_size) {
+        chunk.clear();
+        while (chunk.size() + options.line_size <= 64 * 1024) {
+            std::string line = "line " + std::to_string(line_number) + (line_number % options.needle_every == 0 ? " needle " : " ");
+            line.resize(options.line_size - 1, 'x');
+            chunk += line;
+            chunk += '\n';
+            line_number += 1;
+        }
+        log->append(chunk.data(), chunk.size());
+        written += chunk.size();
+    }
+    const time_t last = time(nullptr);
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    info("wrote " + std::to_string(line_number) + " lines in " + std::to_string(seconds) + "s, over "
+        + std::to_string(last - first + 1) + " distinct seconds of timestamps");
+    if (last == first) {
+        warn("all lines have the same timestamp, use a larger --size-mib for meaningful range searches");
+    }
+
+    run_searches(*log, first, last, written, "uncompressed");
+    if (options.compress) {
+        // reopening picks up the active segment as a sealed one, so compact() compresses all of it
+        log.reset();
+        log = std::make_unique<WorkerLog>(log_directory, policy);
+        start = std::chrono::steady_clock::now();
+        log->compact();
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        size_t disk_size = 0;
+        for (const auto& entry : std::filesystem::directory_iterator(log_directory)) {
+            disk_size += entry.file_size();
+        }
+        info("compressed in " + std::to_string(seconds) + "s, " + std::to_string(disk_size / 1024 / 1024) + " MiB on disk");
+        run_searches(*log, first, last, written, "compressed");
+    }
+    if (!options.keep) {
+        std::filesystem::remove_all(options.directory);
+    }
+    return 0;
+}
@@ -42,23 +42,20 @@ bool attached { false };
 
 namespace commands {
 static constexpr auto help_str = "list of all commands:\n"
-                                 "* attach - attempts to attach to a running instance of the ServerOrganizer headless server\n"
+                                 "* attach [socket-path] - attempts to attach to a running instance of the ServerOrganizer headless server, or to an aggregator\n"
                                  "* help - displays this help";
-void attach(const std::string&) {
+void attach(const std::string& command) {
     struct stat st { };
+    auto args = extract_args(command);
+    const std::string path = args.empty() || args.at(0).empty() ? SOCKET_FILENAME : args.at(0);
     if (socket_fd != -1) {
         error("already attached");
-    } else if (stat(SOCKET_FILENAME, &st) != 0) {
-        error("could not attach - ensure that the server is running");
+    } else if (stat(path.c_str(), &st) != 0) {
+        error("could not attach to \"" + path + "\" - ensure that the server is running");
     } else {
-        info("attaching...");
-        socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
-        struct sockaddr_un addr {
-            AF_UNIX, { }
-        };
-        strncpy(addr.sun_path, SOCKET_FILENAME, sizeof(addr.sun_path) - 1);
-        int ret = connect(socket_fd, (struct sockaddr*)&addr, sizeof(addr));
-        if (ret != 0) {
+        info("attaching to \"" + path + "\"...");
+        socket_fd = connect_to_socket(path);
+        if (socket_fd < 0) {
             error("failed to connect: " + std::string(std::strerror(errno)));
             return;
         }
@@ -129,7 +126,15 @@ int main() {
                     detach();
                 } else {
                     bool success = send_to_server(command);
-                    if (success) {
+                    auto name = command.substr(0, command.find_first_of(' '));
+                    if (success && std::find(Command::Streamed.begin(), Command::Streamed.end(), name) != Command::Streamed.end()) {
+                        // streamed reply, print raw lines until the end marker
+                        std::string msg = recv_from_server();
+                        while (!msg.empty() && msg != Command::StreamEnd) {
+                            com.write(rtrim_copy(msg));
+                            msg = recv_from_server();
+                        }
+                    } else if (success) {
                         std::string msg = recv_from_server();
                         if (msg.empty()) {
                             // error, already handled, ignore
@@ -144,8 +149,8 @@ int main() {
             } else {
                 if (command == "exit") {
                     shutdown = true;
-                } else if (command_function_map.contains(command)) {
-                    command_function_map.at(command)(command);
+                } else if (command_function_map.contains(command.substr(0, command.find(' ')))) {
+                    command_function_map.at(command.substr(0, command.find(' ')))(command);
                     if (attached) {
                         com.set_prompt("server > ");
                     } else {
@@ -28,15 +28,34 @@ void error(const std::string& str) {
     logfile << "[" << get_date_time_string() << "] [ERROR] " << str << std::endl;
 }
 
+// workers are forked from the daemon and have this handler until they exec
+static pid_t daemon_pid = 0;
+static ServerConfig config {};
+
+// only if it's this daemon's, it may have refused to start because another one has it
+static void remove_status_table() {
+    if (StatusTableReader(config.status_table_name).daemon_pid() == daemon_pid) {
+        shm_unlink(config.status_table_name.c_str());
+    }
+}
+
 static void signal_handler(int sig) {
+    if (getpid() != daemon_pid) {
+        // a worker signalled before its exec must not clean up the daemon's socket
+        signal(sig, SIG_DFL);
+        raise(sig);
+        return;
+    }
     switch (sig) {
     case SIGTERM:
         info("exiting through SIGTERM");
-        unlink(SOCKET_FILENAME);
+        unlink(config.socket_path.c_str());
+        remove_status_table();
         exit(0);
     case SIGINT:
         info("exiting through SIGINT");
-        unlink(SOCKET_FILENAME);
+        unlink(config.socket_path.c_str());
+        remove_status_table();
         exit(0);
     default:
         return;
@@ -46,6 +65,8 @@ static void signal_handler(int sig) {
 // headless server
 int main(int argc, char* argv[]) {
     bool clean = false;
+    bool status_table_given = false;
+    bool data_directory_given = false;
     std::string working_directory = ".";
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
@@ -54,11 +75,45 @@ int main(int argc, char* argv[]) {
         } else if (arg == "--dir" && argc > i + 1) {
             working_directory = argv[i + 1];
             i += 1;
+        } else if (arg == "--socket" && argc > i + 1) {
+            config.socket_path = std::filesystem::absolute(argv[i + 1]);
+            i += 1;
+        } else if (arg == "--status-table" && argc > i + 1) {
+            // shm names are a single path component with a leading slash
+            config.status_table_name = argv[i + 1];
+            if (!config.status_table_name.starts_with('/')) {
+                config.status_table_name.insert(0, "/");
+            }
+            status_table_given = true;
+            i += 1;
+        } else if (arg == "--data-dir" && argc > i + 1) {
+            config.data_directory = std::filesystem::absolute(argv[i + 1]);
+            data_directory_given = true;
+            i += 1;
+        } else if (arg == "--log-segment-mib" && argc > i + 1) {
+            config.log_policy.segment_size = std::stoull(argv[i + 1]) * 1024 * 1024;
+            i += 1;
+        } else if (arg == "--log-segment-age" && argc > i + 1) {
+            config.log_policy.segment_age = std::stoll(argv[i + 1]);
+            i += 1;
+        } else if (arg == "--log-retention-mib" && argc > i + 1) {
+            config.log_policy.retention_size = std::stoull(argv[i + 1]) * 1024 * 1024;
+            i += 1;
         } else {
             std::cout << "argument \"" + arg + "\" unknown or missing parameters" << std::endl;
             return -1;
         }
     }
+    // a daemon next to another one must not share its status table and logs just because they weren't given
+    if (config.socket_path != SOCKET_FILENAME) {
+        if (!status_table_given) {
+            config.status_table_name = status_table_name_for_socket(config.socket_path);
+        }
+        if (!data_directory_given) {
+            config.data_directory = config.socket_path + ".data";
+        }
+    }
+    daemon_pid = getpid();
     signal(SIGTERM, signal_handler);
     signal(SIGINT, signal_handler);
     struct stat st { };
@@ -81,16 +136,17 @@ int main(int argc, char* argv[]) {
     info("working directory: " + cwd.string());
     if (clean) {
         info("cleaning up previous runs");
-        if (stat(SOCKET_FILENAME, &st) == 0) {
-            ret = unlink(SOCKET_FILENAME);
+        if (stat(config.socket_path.c_str(), &st) == 0) {
+            ret = unlink(config.socket_path.c_str());
             if (ret != 0) {
-                error("unlinking \"" + std::string(SOCKET_FILENAME) + "\" failed: " + std::string(std::strerror(errno))
+                error("unlinking \"" + config.socket_path + "\" failed: " + std::string(std::strerror(errno))
                     + ". if the file exists, removing it manually will fix this issue.");
             }
         } else {
             info("socket file not found, not removing it");
         }
     }
-    ServerOrganizer s_o_instance;
+    info("socket: " + config.socket_path + ", status table: " + config.status_table_name + ", data directory: " + config.data_directory);
+    ServerOrganizer s_o_instance(config);
     return s_o_instance.run();
 }
\ No newline at end of file
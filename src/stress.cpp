@@ -0,0 +1,634 @@
+#include "Common.h"
+#include "EventJournal.h"
+#include "StatusTable.h"
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// crash-storm and load stress tool. starts its own headless server, registers thousands of synthetic
+// workers (ServerOrganizer_stress_worker), kills them all at once and floods the daemon with restarts,
+// while clients hammer `list` and `query`. afterwards, every worker's event journal, the status table
+// and the daemon's replies are checked against what the tool did. exits with 1 on any violation.
+
+static std::mutex output_mutex;
+
+void info(const std::string& str) {
+    std::lock_guard guard(output_mutex);
+    std::cout << "[" << get_time_string() << "] [INFO] " << str << std::endl;
+}
+
+void warn(const std::string& str) {
+    std::lock_guard guard(output_mutex);
+    std::cout << "[" << get_time_string() << "] [WARNING] " << str << std::endl;
+}
+
+void error(const std::string& str) {
+    std::lock_guard guard(output_mutex);
+    std::cout << "[" << get_time_string() << "] [ERROR] " << str << std::endl;
+}
+
+namespace {
+struct Options {
+    size_t workers { 1000 };
+    // how many of the workers crash in a loop, with autorestart on
+    size_t crashers { 50 };
+    size_t clients { 8 };
+    size_t sweeps { 3 };
+    size_t storm_rounds { 3 };
+    long lines_per_sec { 2 };
+    long timeout { 120 };
+    std::string server;
+    std::string worker;
+};
+
+// the daemon runs on its own socket, status table and data directory, so it can't collide with another one
+std::string socket_path;
+std::string status_table_name;
+std::string data_directory;
+
+std::atomic<uint64_t> violations { 0 };
+std::atomic_bool daemon_died { false };
+
+void violation(const std::string& str) {
+    violations += 1;
+    error("INVARIANT VIOLATED: " + str);
+}
+
+// a persistent connection to the daemon, one request at a time
+class Connection {
+public:
+    Connection()
+        : m_fd(connect_to_socket(socket_path)) {
+    }
+    ~Connection() {
+        if (m_fd >= 0) {
+            shutdown(m_fd, SHUT_RDWR);
+            close(m_fd);
+        }
+    }
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    bool is_open() const { return m_fd >= 0; }
+
+    // returns the reply, or an empty string if the connection broke
+    std::string request(const std::string& command) {
+        if (m_fd < 0) {
+            return "";
+        }
+        auto data = Message::from_string(command).serialize();
+        if (send(m_fd, data.data(), data.size(), MSG_NOSIGNAL) != ssize_t(data.size())
+            || recv(m_fd, data.data(), data.size(), MSG_WAITALL) != ssize_t(data.size())) {
+            close(m_fd);
+            m_fd = -1;
+            return "";
+        }
+        return Message::deserialize(data).to_string();
+    }
+
+private:
+    int m_fd { -1 };
+};
+
+struct StressWorker {
+    std::string identifier;
+    std::string directory;
+    bool crasher { false };
+    // what the tool did to the worker, which the journal has to match
+    uint32_t kills { 0 };
+    uint32_t restarts_queued { 0 };
+};
+
+// what a worker's journal says, and whether it's consistent in itself
+struct JournalCounts {
+    uint32_t registers { 0 };
+    uint32_t autorestarts { 0 };
+    uint32_t restarts { 0 };
+    uint32_t kills { 0 };
+    uint32_t requested_exits { 0 };
+    uint32_t crashes { 0 };
+    uint32_t removes { 0 };
+    // instances which were started, but whose exit isn't recorded (yet)
+    uint32_t running { 0 };
+    int32_t last_pid { 0 };
+    std::vector<int64_t> autorestart_latencies;
+    std::vector<int64_t> restart_latencies;
+    // empty if consistent
+    std::string inconsistency;
+};
+
+JournalCounts read_journal(const StressWorker& worker) {
+    JournalCounts counts {};
+    EventJournalReader reader(event_journal_path(worker.directory));
+    std::vector<int32_t> started;
+    std::vector<int32_t> running;
+    int64_t last_timestamp = 0;
+    for (const auto& record : reader.records()) {
+        if (record.timestamp < last_timestamp && counts.inconsistency.empty()) {
+            counts.inconsistency = "timestamps go backwards";
+        }
+        last_timestamp = record.timestamp;
+        switch (record.type) {
+        case EventType::Started:
+            if (std::find(started.begin(), started.end(), record.pid) != started.end() && counts.inconsistency.empty()) {
+                counts.inconsistency = "pid " + std::to_string(record.pid) + " started twice";
+            }
+            started.push_back(record.pid);
+            running.push_back(record.pid);
+            counts.last_pid = record.pid;
+            if (record.reason == EventReason::Register) {
+                counts.registers += 1;
+            } else if (record.reason == EventReason::Autorestart) {
+                counts.autorestarts += 1;
+                if (record.duration >= 0) {
+                    counts.autorestart_latencies.push_back(record.duration);
+                }
+            } else if (record.reason == EventReason::Restart) {
+                counts.restarts += 1;
+                if (record.duration >= 0) {
+                    counts.restart_latencies.push_back(record.duration);
+                }
+            }
+            break;
+        case EventType::Exited:
+        case EventType::Signalled:
+            if (std::erase(running, record.pid) == 0 && counts.inconsistency.empty()) {
+                counts.inconsistency = "pid " + std::to_string(record.pid) + " exited without running";
+            }
+            if (record.reason == EventReason::Requested) {
+                counts.requested_exits += 1;
+            } else {
+                counts.crashes += 1;
+                if (record.type == EventType::Signalled && record.code == SIGKILL) {
+                    counts.kills += 1;
+                }
+            }
+            break;
+        case EventType::Removed:
+            counts.removes += 1;
+            break;
+        }
+    }
+    if (!reader.records().empty() && reader.records().front().reason != EventReason::Register && counts.inconsistency.empty()) {
+        counts.inconsistency = "doesn't start with the registration";
+    }
+    counts.running = uint32_t(running.size());
+    return counts;
+}
+
+struct DaemonSample {
+    uint64_t rss_kib { 0 };
+    uint64_t threads { 0 };
+    uint64_t fds { 0 };
+};
+
+DaemonSample sample_daemon(pid_t pid) {
+    DaemonSample sample {};
+    std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.starts_with("VmRSS:")) {
+            sample.rss_kib = std::strtoull(line.c_str() + 6, nullptr, 10);
+        } else if (line.starts_with("Threads:")) {
+            sample.threads = std::strtoull(line.c_str() + 8, nullptr, 10);
+        }
+    }
+    std::error_code ec;
+    for (auto iter = std::filesystem::directory_iterator("/proc/" + std::to_string(pid) + "/fd", ec);
+         !ec && iter != std::filesystem::directory_iterator(); iter.increment(ec)) {
+        sample.fds += 1;
+    }
+    return sample;
+}
+
+int64_t percentile(const std::vector<int64_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    return sorted.at(std::min(size_t(p * double(sorted.size() - 1) + 0.5), sorted.size() - 1));
+}
+
+std::string format_latencies(std::vector<int64_t> us) {
+    if (us.empty()) {
+        return "n/a";
+    }
+    std::sort(us.begin(), us.end());
+    char buf[256];
+    snprintf(buf, sizeof(buf), "n=%zu p50 %.2fms, p90 %.2fms, p99 %.2fms, max %.2fms", us.size(),
+        double(percentile(us, 0.5)) / 1e3, double(percentile(us, 0.9)) / 1e3,
+        double(percentile(us, 0.99)) / 1e3, double(us.back()) / 1e3);
+    return buf;
+}
+
+// polls `done` until it returns true, or the timeout passes or the daemon dies
+bool wait_until(const std::function<bool()>& done, long timeout_sec) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeout_sec);
+    while (!daemon_died) {
+        if (done()) {
+            return true;
+        }
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    return false;
+}
+
+// runs `func(connection, index)` for every index in [0, count) on `threads` connections in parallel
+void parallel_requests(size_t threads, size_t count, const std::function<void(Connection&, size_t)>& func) {
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < threads; ++t) {
+        pool.emplace_back([&, t] {
+            Connection connection;
+            for (size_t i = t; i < count; i += threads) {
+                func(connection, i);
+            }
+        });
+    }
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
+
+// see stress_worker.cpp
+void write_worker_config(const std::string& working_directory, bool crasher, size_t index, long lines_per_sec) {
+    std::ofstream conf(working_directory + "/stress_worker.conf", std::ios::trunc);
+    conf << "lines_per_sec=" << lines_per_sec << "\n";
+    if (crasher) {
+        // staggered, so the crashes don't all line up
+        conf << "lifetime_ms=" << 1000 + index % 1000 << "\n";
+        if (index % 2 == 0) {
+            conf << "exit_code=1\n";
+        } else {
+            conf << "signal=" << SIGUSR1 << "\n";
+        }
+    }
+}
+
+std::map<std::string, WorkerStatus> read_status_table() {
+    std::map<std::string, WorkerStatus> result;
+    StatusTableReader reader(status_table_name);
+    for (const auto& status : reader.snapshot()) {
+        result.insert({ status.identifier, status });
+    }
+    return result;
+}
+}
+
+int main(int argc, char* argv[]) {
+    Options options {};
+    const auto own_directory = std::filesystem::canonical("/proc/self/exe").parent_path();
+    options.server = own_directory / "ServerOrganizer_HeadlessServer";
+    options.worker = own_directory / "ServerOrganizer_stress_worker";
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cout << "argument \"" + arg + "\" unknown or missing parameters" << std::endl;
+            return -1;
+        }
+        std::string value = argv[++i];
+        if (arg == "--workers") {
+            options.workers = std::stoull(value);
+        } else if (arg == "--crashers") {
+            options.crashers = std::stoull(value);
+        } else if (arg == "--clients") {
+            options.clients = std::max<size_t>(1, std::stoull(value));
+        } else if (arg == "--sweeps") {
+            options.sweeps = std::stoull(value);
+        } else if (arg == "--storm-rounds") {
+            options.storm_rounds = std::stoull(value);
+        } else if (arg == "--lines-per-sec") {
+            options.lines_per_sec = std::stol(value);
+        } else if (arg == "--timeout") {
+            options.timeout = std::stol(value);
+        } else if (arg == "--server") {
+            options.server = value;
+        } else if (arg == "--worker") {
+            options.worker = value;
+        } else {
+            std::cout << "argument \"" + arg + "\" unknown or missing parameters" << std::endl;
+            return -1;
+        }
+    }
+    options.crashers = std::min(options.crashers, options.workers);
+    for (const auto& path : { options.server, options.worker }) {
+        if (access(path.c_str(), X_OK) != 0) {
+            std::cout << "\"" << path << "\" is not executable, see --server and --worker" << std::endl;
+            return -1;
+        }
+    }
+    char directory_template[] = "/tmp/ServerOrganizer_stress.XXXXXX";
+    if (!mkdtemp(directory_template)) {
+        std::cout << "mkdtemp failed: " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+    const std::string directory = directory_template;
+    socket_path = directory + "/socket";
+    status_table_name = "/ServerOrganizer_stress_" + std::to_string(getpid());
+    data_directory = directory + "/data";
+
+    info("starting \"" + options.server + "\" in \"" + directory + "\"");
+    pid_t daemon_pid = fork();
+    if (daemon_pid == 0) {
+        int fd = open((directory + "/daemon.out").c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        execl(options.server.c_str(), options.server.c_str(), "--dir", directory.c_str(), "--socket", socket_path.c_str(),
+            "--status-table", status_table_name.c_str(), "--data-dir", data_directory.c_str(), nullptr);
+        exit(55);
+    }
+    if (!wait_until([] { return Connection().is_open(); }, 10)) {
+        error("the headless server didn't come up, see \"" + directory + "/daemon.out\"");
+        kill(daemon_pid, SIGKILL);
+        return 1;
+    }
+
+    // watches the daemon's resources, and that it's still alive. the probe's connection has to be gone first.
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    const DaemonSample baseline = sample_daemon(daemon_pid);
+    DaemonSample peak = baseline;
+    std::atomic_bool stop_sampling { false };
+    std::thread sampler([&] {
+        while (!stop_sampling) {
+            int status = 0;
+            if (waitpid(daemon_pid, &status, WNOHANG) == daemon_pid) {
+                daemon_died = true;
+                violation(WIFSIGNALED(status) ? "the daemon died via " + std::string(strsignal(WTERMSIG(status)))
+                                              : "the daemon exited with code " + std::to_string(WEXITSTATUS(status)));
+                return;
+            }
+            auto sample = sample_daemon(daemon_pid);
+            peak.rss_kib = std::max(peak.rss_kib, sample.rss_kib);
+            peak.threads = std::max(peak.threads, sample.threads);
+            peak.fds = std::max(peak.fds, sample.fds);
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    });
+
+    std::vector<StressWorker> workers(options.workers);
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers.at(i).identifier = "stress" + std::to_string(getpid()) + "_" + std::to_string(i);
+        workers.at(i).directory = worker_directory(data_directory, workers.at(i).identifier);
+        workers.at(i).crasher = i < options.crashers;
+        std::filesystem::remove_all(workers.at(i).directory);
+        std::filesystem::create_directories(directory + "/" + workers.at(i).identifier);
+    }
+    auto working_directory = [&](const StressWorker& worker) {
+        return directory + "/" + worker.identifier;
+    };
+
+    // 1. register everything, crashers start out stable so they can't crash before autorestart is on
+    for (size_t i = 0; i < workers.size(); ++i) {
+        write_worker_config(working_directory(workers.at(i)), false, i, options.lines_per_sec);
+    }
+    auto start = std::chrono::steady_clock::now();
+    parallel_requests(options.clients, workers.size(), [&](Connection& connection, size_t i) {
+        auto& worker = workers.at(i);
+        auto reply = connection.request("register " + worker.identifier + " " + options.worker + " " + working_directory(worker));
+        if (reply != "registered \"" + worker.identifier + "\"") {
+            violation("register " + worker.identifier + " replied \"" + reply + "\"");
+        }
+        reply = connection.request("autorestart " + worker.identifier + " on");
+        if (!reply.starts_with("autorestart turned ON")) {
+            violation("autorestart " + worker.identifier + " replied \"" + reply + "\"");
+        }
+    });
+    info("registered " + std::to_string(workers.size()) + " workers in "
+        + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()) + "ms");
+
+    // 2. clients hammer `list` and `query` until the storms are over
+    std::atomic_bool stop_hammering { false };
+    std::mutex hammer_mutex;
+    std::vector<int64_t> hammer_latencies;
+    std::vector<std::thread> hammers;
+    for (size_t t = 0; t < options.clients; ++t) {
+        hammers.emplace_back([&, t] {
+            Connection connection;
+            std::minstd_rand random(uint32_t(t + 1));
+            std::vector<int64_t> latencies;
+            while (!stop_hammering && !daemon_died) {
+                const auto& worker = workers.at(random() % workers.size());
+                const bool list = random() % 4 == 0;
+                auto before = std::chrono::steady_clock::now();
+                auto reply = connection.request(list ? "list" : "query " + worker.identifier + " pid");
+                latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - before).count());
+                if (reply.empty()) {
+                    violation("a client's connection broke");
+                    break;
+                } else if (list && !reply.starts_with("list of all workers:")) {
+                    violation("list replied \"" + reply.substr(0, 100) + "\"");
+                } else if (!list && !std::all_of(reply.begin(), reply.end(), ::isdigit)) {
+                    violation("query " + worker.identifier + " pid replied \"" + reply + "\"");
+                }
+            }
+            std::lock_guard guard(hammer_mutex);
+            hammer_latencies.insert(hammer_latencies.end(), latencies.begin(), latencies.end());
+        });
+    }
+
+    // 3. the crashers start crashing in a loop once restarted with their real config
+    for (size_t i = 0; i < options.crashers; ++i) {
+        write_worker_config(working_directory(workers.at(i)), true, i, options.lines_per_sec);
+    }
+    parallel_requests(options.clients, options.crashers, [&](Connection& connection, size_t i) {
+        auto reply = connection.request("restart " + workers.at(i).identifier);
+        if (reply.starts_with("queued")) {
+            workers.at(i).restarts_queued += 1;
+        } else {
+            violation("restart " + workers.at(i).identifier + " replied \"" + reply + "\"");
+        }
+    });
+
+    // whether every worker's journal matches what was done to it, and stable workers are running again
+    auto settled = [&](bool report) {
+        auto table = read_status_table();
+        bool result = true;
+        for (const auto& worker : workers) {
+            auto counts = read_journal(worker);
+            std::string problem;
+            if (!counts.inconsistency.empty()) {
+                problem = "journal " + counts.inconsistency;
+            } else if (counts.registers != 1) {
+                problem = std::to_string(counts.registers) + " registrations";
+            } else if (counts.restarts != worker.restarts_queued) {
+                problem = std::to_string(counts.restarts) + " restarts, expected " + std::to_string(worker.restarts_queued);
+            } else if (worker.crasher) {
+                // only crashers which are waiting to be restarted can be one behind
+                if (counts.autorestarts > counts.crashes || counts.autorestarts + 1 < counts.crashes) {
+                    problem = std::to_string(counts.autorestarts) + " autorestarts after " + std::to_string(counts.crashes) + " crashes";
+                }
+            } else if (counts.kills != worker.kills || counts.autorestarts != worker.kills) {
+                problem = std::to_string(counts.kills) + " kills and " + std::to_string(counts.autorestarts)
+                    + " autorestarts, expected " + std::to_string(worker.kills);
+            } else if (counts.requested_exits != worker.restarts_queued || counts.running != 1) {
+                problem = std::to_string(counts.requested_exits) + " requested exits and " + std::to_string(counts.running) + " instances running";
+            } else if (!table.contains(worker.identifier) || table.at(worker.identifier).state != WorkerState::Running
+                || table.at(worker.identifier).pid != counts.last_pid) {
+                problem = "status table doesn't show pid " + std::to_string(counts.last_pid) + " running";
+            } else if (table.at(worker.identifier).restarts != worker.kills + worker.restarts_queued) {
+                problem = "status table counts " + std::to_string(table.at(worker.identifier).restarts) + " restarts";
+            }
+            if (!problem.empty()) {
+                if (report) {
+                    violation(worker.identifier + ": " + problem);
+                }
+                result = false;
+            }
+        }
+        return result;
+    };
+    if (!wait_until([&] { return settled(false); }, options.timeout)) {
+        settled(true);
+    }
+
+    // 4. mass exits, as in an OOM sweep: SIGKILL every stable worker at once
+    std::vector<int64_t> recovery_times;
+    for (size_t sweep = 0; sweep < options.sweeps && !daemon_died; ++sweep) {
+        auto table = read_status_table();
+        std::map<std::string, int32_t> killed;
+        for (auto& worker : workers) {
+            if (!worker.crasher && table.contains(worker.identifier) && kill(table.at(worker.identifier).pid, SIGKILL) == 0) {
+                killed.insert({ worker.identifier, table.at(worker.identifier).pid });
+                worker.kills += 1;
+            }
+        }
+        start = std::chrono::steady_clock::now();
+        bool recovered = wait_until([&] {
+            auto now = read_status_table();
+            return std::all_of(killed.begin(), killed.end(), [&](const auto& pair) {
+                return now.contains(pair.first) && now.at(pair.first).pid != pair.second && now.at(pair.first).state == WorkerState::Running;
+            });
+        }, options.timeout);
+        auto took = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        recovery_times.push_back(took);
+        info("sweep " + std::to_string(sweep + 1) + ": killed " + std::to_string(killed.size()) + " workers, "
+            + (recovered ? "all running again after " + std::to_string(took / 1000) + "ms" : "not all running again"));
+        if (!recovered) {
+            violation("sweep " + std::to_string(sweep + 1) + " didn't recover within " + std::to_string(options.timeout) + "s");
+        }
+    }
+
+    // 5. restart storms: every client restarts every worker, in several rounds
+    start = std::chrono::steady_clock::now();
+    for (size_t round = 0; round < options.storm_rounds && !daemon_died; ++round) {
+        parallel_requests(options.clients, workers.size(), [&](Connection& connection, size_t i) {
+            auto reply = connection.request("restart " + workers.at(i).identifier);
+            if (reply.starts_with("queued")) {
+                workers.at(i).restarts_queued += 1;
+            } else {
+                violation("restart " + workers.at(i).identifier + " replied \"" + reply + "\"");
+            }
+        });
+    }
+    bool stormed = wait_until([&] { return settled(false); }, options.timeout);
+    info("restart storm of " + std::to_string(options.storm_rounds) + " rounds " + (stormed ? "settled after " : "didn't settle after ")
+        + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()) + "ms");
+    if (!stormed) {
+        settled(true);
+    }
+
+    stop_hammering = true;
+    for (auto& thread : hammers) {
+        thread.join();
+    }
+
+    // 6. remove everything, after which no instance may be left and the daemon has to be back where it started
+    parallel_requests(options.clients, workers.size(), [&](Connection& connection, size_t i) {
+        auto reply = connection.request("remove " + workers.at(i).identifier);
+        if (!reply.starts_with("worker \"" + workers.at(i).identifier + "\"") || reply.find("removed") == std::string::npos) {
+            violation("remove " + workers.at(i).identifier + " replied \"" + reply + "\"");
+        }
+    });
+    std::vector<int64_t> autorestart_latencies;
+    std::vector<int64_t> restart_latencies;
+    uint64_t lost_events = 0;
+    auto all_stopped = [&] {
+        return std::all_of(workers.begin(), workers.end(), [](const StressWorker& worker) {
+            auto counts = read_journal(worker);
+            return counts.removes == 1 && counts.running == 0;
+        });
+    };
+    if (!wait_until(all_stopped, options.timeout)) {
+        for (const auto& worker : workers) {
+            auto counts = read_journal(worker);
+            if (counts.removes != 1 || counts.running != 0) {
+                lost_events += counts.running + (counts.removes == 0 ? 1 : 0);
+                violation(worker.identifier + ": " + std::to_string(counts.removes) + " removals, exits of "
+                    + std::to_string(counts.running) + " instances not recorded");
+            }
+        }
+    }
+    for (const auto& worker : workers) {
+        auto counts = read_journal(worker);
+        autorestart_latencies.insert(autorestart_latencies.end(), counts.autorestart_latencies.begin(), counts.autorestart_latencies.end());
+        restart_latencies.insert(restart_latencies.end(), counts.restart_latencies.begin(), counts.restart_latencies.end());
+        if (!worker.crasher) {
+            lost_events += std::max<int64_t>(0, int64_t(worker.kills) - counts.kills) + std::max<int64_t>(0, int64_t(worker.kills) - counts.autorestarts);
+        }
+        lost_events += std::max<int64_t>(0, int64_t(worker.restarts_queued) - counts.restarts);
+    }
+    auto table = read_status_table();
+    for (const auto& worker : workers) {
+        if (table.contains(worker.identifier)) {
+            violation(worker.identifier + " is still in the status table after it was removed");
+        }
+    }
+    // client threads and the threads reading worker output go away asynchronously
+    DaemonSample after {};
+    bool released = wait_until([&] {
+        after = sample_daemon(daemon_pid);
+        return after.threads <= baseline.threads && after.fds <= baseline.fds;
+    }, options.timeout);
+    if (!released) {
+        violation("the daemon still has " + std::to_string(after.threads) + " threads and " + std::to_string(after.fds)
+            + " fds, up from " + std::to_string(baseline.threads) + " and " + std::to_string(baseline.fds));
+    }
+
+    stop_sampling = true;
+    sampler.join();
+    if (!daemon_died) {
+        kill(daemon_pid, SIGTERM);
+        waitpid(daemon_pid, nullptr, 0);
+    }
+
+    info("restart latency (autorestart after a kill): " + format_latencies(autorestart_latencies));
+    info("restart latency (`restart`): " + format_latencies(restart_latencies));
+    info("sweep recovery: " + format_latencies(recovery_times));
+    info("client request latency: " + format_latencies(hammer_latencies));
+    info("lost events: " + std::to_string(lost_events));
+    info("daemon rss: " + std::to_string(baseline.rss_kib) + " KiB at start, " + std::to_string(peak.rss_kib) + " KiB peak, "
+        + std::to_string(after.rss_kib) + " KiB at the end");
+    info("daemon threads: " + std::to_string(baseline.threads) + " at start, " + std::to_string(peak.threads) + " peak, "
+        + std::to_string(after.threads) + " at the end");
+    info("daemon fds: " + std::to_string(baseline.fds) + " at start, " + std::to_string(peak.fds) + " peak, "
+        + std::to_string(after.fds) + " at the end");
+    if (lost_events > 0) {
+        violation(std::to_string(lost_events) + " events were lost");
+    }
+    if (violations > 0) {
+        error(std::to_string(violations) + " invariant violations, the daemon's output is in \"" + directory + "/daemon.out\"");
+        return 1;
+    }
+    // the workers' directories are in there too
+    std::filesystem::remove_all(directory);
+    info("passed");
+    return 0;
+}
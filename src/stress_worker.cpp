@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+// synthetic worker for ServerOrganizer_stress. the daemon starts workers without arguments, so the
+// behaviour is read from stress_worker.conf in the working directory, as `key=value` lines:
+//   lifetime_ms    - how long to run before exiting, 0 runs until killed (default 0)
+//   exit_code      - what to exit with at the end of the lifetime (default 0)
+//   signal         - if not 0, raise this signal at the end of the lifetime instead of exiting (default 0)
+//   lines_per_sec  - how many lines of output to print per second (default 0)
+//   line_size      - how long each line is, including the newline (default 80)
+int main() {
+    long lifetime_ms = 0;
+    int exit_code = 0;
+    int signal_number = 0;
+    long lines_per_sec = 0;
+    long line_size = 80;
+    std::ifstream conf("stress_worker.conf");
+    std::string line;
+    while (std::getline(conf, line)) {
+        auto eq = line.find('=');
+        if (eq == std::string::npos) {
+            continue;
+        }
+        auto key = line.substr(0, eq);
+        long value = std::strtol(line.c_str() + eq + 1, nullptr, 10);
+        if (key == "lifetime_ms") {
+            lifetime_ms = value;
+        } else if (key == "exit_code") {
+            exit_code = int(value);
+        } else if (key == "signal") {
+            signal_number = int(value);
+        } else if (key == "lines_per_sec") {
+            lines_per_sec = value;
+        } else if (key == "line_size") {
+            line_size = std::max(1L, value);
+        }
+    }
+    std::printf("stress worker %d started\n", getpid());
+    std::fflush(stdout);
+    const std::string output_line = std::string(line_size - 1, 'x') + "\n";
+    const pid_t parent = getppid();
+    const auto start = std::chrono::steady_clock::now();
+    const auto end = start + std::chrono::milliseconds(lifetime_ms);
+    long lines_written = 0;
+    while (lifetime_ms == 0 || std::chrono::steady_clock::now() < end) {
+        // don't outlive the daemon
+        if (getppid() != parent) {
+            return 0;
+        }
+        // sleep until the next line is due, the lifetime ends, or the parent has to be checked again.
+        // thousands of these run at once, so they must not wake up more often than needed.
+        auto wakeup = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        if (lifetime_ms != 0) {
+            wakeup = std::min(wakeup, end);
+        }
+        if (lines_per_sec > 0) {
+            auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            while (lines_written < long(elapsed * double(lines_per_sec))) {
+                std::fwrite(output_line.data(), 1, output_line.size(), stdout);
+                lines_written += 1;
+            }
+            std::fflush(stdout);
+            auto next_line = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(double(lines_written + 1) / double(lines_per_sec)));
+            wakeup = std::min(wakeup, next_line);
+        }
+        std::this_thread::sleep_until(wakeup);
+    }
+    if (signal_number != 0) {
+        std::signal(signal_number, SIG_DFL);
+        raise(signal_number);
+    }
+    return exit_code;
+}
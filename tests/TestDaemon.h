@@ -0,0 +1,117 @@
+#ifndef SERVERORGANIZER_TESTDAEMON_H
+#define SERVERORGANIZER_TESTDAEMON_H
+
+#include "Common.h"
+#include <chrono>
+#include <csignal>
+#include <fcntl.h>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// helpers for the integration tests, which each run their own headless servers on private paths
+
+// a persistent connection to a headless server or aggregator, one request at a time
+class TestConnection {
+public:
+    explicit TestConnection(const std::string& socket_path)
+        : m_fd(connect_to_socket(socket_path)) {
+    }
+    ~TestConnection() {
+        if (m_fd >= 0) {
+            close(m_fd);
+        }
+    }
+    TestConnection(const TestConnection&) = delete;
+    TestConnection& operator=(const TestConnection&) = delete;
+
+    bool is_open() const { return m_fd >= 0; }
+
+    // returns the reply, or an empty string if the connection broke
+    std::string request(const std::string& command) {
+        if (m_fd < 0) {
+            return "";
+        }
+        auto data = Message::from_string(command).serialize();
+        if (send(m_fd, data.data(), data.size(), MSG_NOSIGNAL) != ssize_t(data.size())
+            || recv(m_fd, data.data(), data.size(), MSG_WAITALL) != ssize_t(data.size())) {
+            close(m_fd);
+            m_fd = -1;
+            return "";
+        }
+        return Message::deserialize(data).to_string();
+    }
+
+private:
+    int m_fd { -1 };
+};
+
+inline bool wait_until(const std::function<bool()>& condition, double seconds) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+    while (!condition()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    return true;
+}
+
+// a headless server with its socket in `directory`. only --socket is given, so its status table and
+// data directory are derived from that, like for anyone running several daemons side by side.
+class TestDaemon {
+public:
+    TestDaemon(const std::string& server, const std::string& directory)
+        : m_directory(directory)
+        , m_socket_path(directory + "/socket") {
+        std::filesystem::create_directories(directory);
+        m_pid = fork();
+        if (m_pid == 0) {
+            int fd = open((directory + "/daemon.out").c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            execl(server.c_str(), server.c_str(), "--dir", directory.c_str(), "--socket", m_socket_path.c_str(), nullptr);
+            _exit(55);
+        }
+        wait_until([this] { return TestConnection(m_socket_path).is_open(); }, 10);
+    }
+    ~TestDaemon() {
+        stop();
+    }
+    TestDaemon(const TestDaemon&) = delete;
+    TestDaemon& operator=(const TestDaemon&) = delete;
+
+    bool is_up() { return TestConnection(m_socket_path).is_open(); }
+    const std::string& socket_path() const { return m_socket_path; }
+    const std::string& directory() const { return m_directory; }
+    pid_t pid() const { return m_pid; }
+
+    // removes the workers which are left, the daemon doesn't stop them when it's terminated
+    void stop() {
+        if (m_pid > 0) {
+            TestConnection control(m_socket_path);
+            std::vector<std::string> lines;
+            split(control.request("list"), lines, '\n');
+            // the first line is "list of all workers:", then "<identifier> (<state>)"
+            for (size_t i = 1; i < lines.size(); ++i) {
+                control.request("remove " + lines.at(i).substr(0, lines.at(i).find(' ')));
+            }
+            kill(m_pid, SIGTERM);
+            waitpid(m_pid, nullptr, 0);
+            m_pid = -1;
+        }
+    }
+
+private:
+    std::string m_directory;
+    std::string m_socket_path;
+    pid_t m_pid { -1 };
+};
+
+#endif //SERVERORGANIZER_TESTDAEMON_H
@@ -0,0 +1,188 @@
+#include "Common.h"
+#include "StatusTable.h"
+#include "TestDaemon.h"
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <sys/un.h>
+
+// runs two headless servers side by side, started with nothing but their own --socket, and an aggregator
+// over them plus an instance whose socket doesn't exist and one which never replies. checks that the
+// daemons don't share state, that the aggregator merges their replies, and that it reports the instances
+// which failed without holding up the others' replies.
+
+void info(const std::string& str) {
+    std::cout << "[" << get_time_string() << "] [INFO] " << str << std::endl;
+}
+
+void warn(const std::string& str) {
+    std::cout << "[" << get_time_string() << "] [WARNING] " << str << std::endl;
+}
+
+void error(const std::string& str) {
+    std::cout << "[" << get_time_string() << "] [ERROR] " << str << std::endl;
+}
+
+namespace {
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        failures += 1;
+        error("FAILED: " + what);
+    }
+}
+
+bool contains(const std::string& str, const std::string& part) {
+    return str.find(part) != std::string::npos;
+}
+
+// the aggregator, with its output in `directory`/aggregator.out
+class TestAggregator {
+public:
+    TestAggregator(const std::string& aggregator, const std::string& directory, const std::vector<std::string>& instances, int timeout_ms)
+        : m_socket_path(directory + "/aggregator") {
+        std::vector<std::string> args = { aggregator, "--socket", m_socket_path, "--timeout-ms", std::to_string(timeout_ms) };
+        for (const auto& instance : instances) {
+            args.push_back("--instance");
+            args.push_back(instance);
+        }
+        m_pid = fork();
+        if (m_pid == 0) {
+            int fd = open((directory + "/aggregator.out").c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            std::vector<char*> argv;
+            for (auto& arg : args) {
+                argv.push_back(arg.data());
+            }
+            argv.push_back(nullptr);
+            execv(argv.at(0), argv.data());
+            _exit(55);
+        }
+        wait_until([this] { return TestConnection(m_socket_path).is_open(); }, 10);
+    }
+    ~TestAggregator() {
+        kill(m_pid, SIGTERM);
+        waitpid(m_pid, nullptr, 0);
+    }
+    TestAggregator(const TestAggregator&) = delete;
+    TestAggregator& operator=(const TestAggregator&) = delete;
+
+    const std::string& socket_path() const { return m_socket_path; }
+
+private:
+    std::string m_socket_path;
+    pid_t m_pid { -1 };
+};
+
+// a unix socket which accepts connections into its backlog, but never replies
+int hung_socket(const std::string& path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr { AF_UNIX, {} };
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+}
+
+int main(int argc, char* argv[]) {
+    const auto own_directory = std::filesystem::canonical("/proc/self/exe").parent_path();
+    std::string server = own_directory / "ServerOrganizer_HeadlessServer";
+    std::string aggregator = own_directory / "ServerOrganizer_Aggregator";
+    std::string worker = own_directory / "ServerOrganizer_echo_worker";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--server") {
+            server = argv[i + 1];
+        } else if (arg == "--aggregator") {
+            aggregator = argv[i + 1];
+        } else if (arg == "--worker") {
+            worker = argv[i + 1];
+        }
+    }
+    char directory_template[] = "/tmp/ServerOrganizer_aggregator_test.XXXXXX";
+    if (!mkdtemp(directory_template)) {
+        error("mkdtemp failed");
+        return 1;
+    }
+    const std::string directory = directory_template;
+    const int hung_fd = hung_socket(directory + "/hung");
+    check(hung_fd >= 0, "the hung instance's socket was created");
+
+    {
+        auto a = std::make_unique<TestDaemon>(server, directory + "/a");
+        auto b = std::make_unique<TestDaemon>(server, directory + "/b");
+        check(a->is_up() && b->is_up(), "both headless servers came up");
+        TestConnection control_a(a->socket_path());
+        TestConnection control_b(b->socket_path());
+
+        // the echo worker waits for a signal when it isn't given any sockets
+        check(control_a.request("register shared " + worker) == "registered \"shared\"", "register shared on a");
+        check(control_b.request("register shared " + worker) == "registered \"shared\"", "register shared on b");
+        check(control_a.request("register only_a " + worker) == "registered \"only_a\"", "register only_a");
+        check(control_b.request("register only_b " + worker) == "registered \"only_b\"", "register only_b");
+
+        // state derived from the socket path, so nothing is shared
+        check(StatusTableReader(status_table_name_for_socket(a->socket_path())).daemon_pid() == a->pid(), "a has its own status table");
+        check(StatusTableReader(status_table_name_for_socket(b->socket_path())).daemon_pid() == b->pid(), "b has its own status table");
+        check(std::filesystem::exists(a->socket_path() + ".data/only_a") && !std::filesystem::exists(a->socket_path() + ".data/only_b"),
+            "a has its own data directory");
+        check(std::filesystem::exists(b->socket_path() + ".data/only_b") && !std::filesystem::exists(b->socket_path() + ".data/only_a"),
+            "b has its own data directory");
+        const std::string pid_a = control_a.request("query shared pid");
+        const std::string pid_b = control_b.request("query shared pid");
+        check(pid_a != pid_b, "the daemons run separate instances of `shared`");
+
+        const int timeout_ms = 300;
+        TestAggregator aggregated(aggregator, directory,
+            { "a=" + a->socket_path(), "b=" + b->socket_path(), "dead=" + directory + "/dead", "hung=" + directory + "/hung" }, timeout_ms);
+        TestConnection control(aggregated.socket_path());
+        check(control.is_open(), "the aggregator came up");
+
+        auto start = std::chrono::steady_clock::now();
+        auto list = control.request("list");
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        check(list.starts_with("list of all workers on 2 of 4 instances:"), "list counts the instances which replied: " + list);
+        check(contains(list, "[a] shared (running)") && contains(list, "[b] shared (running)")
+                && contains(list, "[a] only_a (running)") && contains(list, "[b] only_b (running)"),
+            "list merges the workers of both daemons: " + list);
+        check(contains(list, "[dead] ERROR - unreachable"), "list reports the dead instance: " + list);
+        check(contains(list, "[hung] ERROR - timed out after " + std::to_string(timeout_ms) + "ms"), "list reports the hung instance: " + list);
+        check(seconds < 2.0, "a hung instance only delays the reply by the timeout, took " + std::to_string(seconds) + "s");
+
+        auto query = control.request("query shared pid");
+        check(contains(query, "a: " + pid_a) && contains(query, "b: " + pid_b), "query merges the replies of both daemons: " + query);
+        check(contains(query, "dead: ERROR - ") && contains(query, "hung: ERROR - timed out"), "query reports the failed instances: " + query);
+        check(control.request("query b/only_b pid") == "b: " + control_b.request("query only_b pid"), "query with an instance prefix");
+        check(control.request("query nothing pid").starts_with("ERROR - unknown worker on the instances which replied"),
+            "query of an unknown worker");
+        check(control.request("query nope/shared pid") == "instance \"nope\" unknown", "query on an unknown instance");
+
+        check(control.request("restart a/shared").starts_with("a: queued"), "restart on one instance");
+        check(wait_until([&] { return control_a.request("query shared pid") != pid_a; }, 10), "a's worker was restarted");
+        check(control_b.request("query shared pid") == pid_b, "b's worker wasn't restarted");
+
+        // an instance which goes away is reported, and picked up again once it's back
+        b.reset();
+        list = control.request("list");
+        check(list.starts_with("list of all workers on 1 of 4 instances:") && contains(list, "[b] ERROR - "),
+            "list reports the stopped instance: " + list);
+        b = std::make_unique<TestDaemon>(server, directory + "/b");
+        check(b->is_up(), "b came back up");
+        check(StatusTableReader(status_table_name_for_socket(b->socket_path())).daemon_pid() == b->pid(), "b took over its stale status table");
+        list = control.request("list");
+        check(list.starts_with("list of all workers on 2 of 4 instances:") && !contains(list, "[b] ERROR"), "list reconnects to b: " + list);
+    }
+    close(hung_fd);
+    if (failures > 0) {
+        error(std::to_string(failures) + " checks failed, the output of the daemons and the aggregator is in \"" + directory + "\"");
+        return 1;
+    }
+    std::filesystem::remove_all(directory);
+    info("passed");
+    return 0;
+}
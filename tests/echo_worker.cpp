@@ -0,0 +1,62 @@
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// echo server for the handover test. accepts on the first socket passed via LISTEN_FDS and replies
+// to every line with "<pid> <line>". on SIGTERM it stops accepting and finishes its open connections,
+// like a worker draining after a handover. it exits once the daemon is gone, so a failed test doesn't leave it behind.
+
+static std::atomic_bool terminating { false };
+
+static void serve(int fd) {
+    const std::string prefix = std::to_string(getpid()) + " ";
+    std::string line;
+    char c;
+    while (read(fd, &c, 1) == 1) {
+        line += c;
+        if (c == '\n') {
+            auto reply = prefix + line;
+            if (send(fd, reply.data(), reply.size(), MSG_NOSIGNAL) != ssize_t(reply.size())) {
+                break;
+            }
+            line.clear();
+        }
+    }
+    close(fd);
+}
+
+int main() {
+    const pid_t parent = getppid();
+    const char* listen_fds = getenv("LISTEN_FDS");
+    const char* listen_pid = getenv("LISTEN_PID");
+    if (!listen_fds || !listen_pid || std::atoi(listen_fds) < 1 || std::atoi(listen_pid) != getpid()) {
+        // not started with sockets yet, they're passed on the next (re)start
+        while (getppid() == parent) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+        return 0;
+    }
+    signal(SIGTERM, [](int) { terminating = true; });
+    std::vector<std::thread> connections;
+    while (!terminating && getppid() == parent) {
+        pollfd pfd { 3, POLLIN, 0 };
+        if (poll(&pfd, 1, 50) <= 0) {
+            continue;
+        }
+        int fd = accept(3, nullptr, nullptr);
+        if (fd >= 0) {
+            connections.emplace_back(serve, fd);
+        }
+    }
+    for (auto& thread : connections) {
+        thread.join();
+    }
+    return 0;
+}
@@ -0,0 +1,170 @@
+#include "Common.h"
+#include "TestDaemon.h"
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <sys/un.h>
+#include <vector>
+
+// restarts an echo server with listen sockets over and over while clients keep connecting, and checks
+// that no connection is refused or dropped. then breaks the executable and checks that a failed handover
+// keeps the old instance running.
+
+void info(const std::string& str) {
+    std::cout << "[" << get_time_string() << "] [INFO] " << str << std::endl;
+}
+
+void warn(const std::string& str) {
+    std::cout << "[" << get_time_string() << "] [WARNING] " << str << std::endl;
+}
+
+void error(const std::string& str) {
+    std::cout << "[" << get_time_string() << "] [ERROR] " << str << std::endl;
+}
+
+namespace {
+std::atomic<int> failures { 0 };
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        failures += 1;
+        error("FAILED: " + what);
+    }
+}
+
+// a connection to the echo server, replies are "<pid> <line>"
+class EchoConnection {
+public:
+    explicit EchoConnection(const std::string& path)
+        : m_fd(connect_to_socket(path)) {
+        timeval timeout { 5, 0 };
+        setsockopt(m_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+    ~EchoConnection() {
+        if (m_fd >= 0) {
+            close(m_fd);
+        }
+    }
+    // returns the pid which replied, or -1
+    int echo(const std::string& line) {
+        auto request = line + "\n";
+        if (m_fd < 0 || send(m_fd, request.data(), request.size(), MSG_NOSIGNAL) != ssize_t(request.size())) {
+            return -1;
+        }
+        std::string reply;
+        char c;
+        while (!reply.ends_with('\n')) {
+            if (read(m_fd, &c, 1) != 1) {
+                return -1;
+            }
+            reply += c;
+        }
+        auto space = reply.find(' ');
+        if (space == std::string::npos || reply.substr(space + 1) != request) {
+            return -1;
+        }
+        return std::atoi(reply.c_str());
+    }
+
+private:
+    int m_fd { -1 };
+};
+}
+
+int main(int argc, char* argv[]) {
+    const auto own_directory = std::filesystem::canonical("/proc/self/exe").parent_path();
+    std::string server = own_directory / "ServerOrganizer_HeadlessServer";
+    std::string worker = own_directory / "ServerOrganizer_echo_worker";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--server") {
+            server = argv[i + 1];
+        } else if (arg == "--worker") {
+            worker = argv[i + 1];
+        }
+    }
+    char directory_template[] = "/tmp/ServerOrganizer_handover_test.XXXXXX";
+    if (!mkdtemp(directory_template)) {
+        error("mkdtemp failed");
+        return 1;
+    }
+    const std::string directory = directory_template;
+    // a copy, so it can be broken later on
+    const std::string executable = directory + "/echo_worker";
+    std::filesystem::copy_file(worker, executable);
+    const std::string echo_socket = directory + "/echo.sock";
+
+    {
+        TestDaemon daemon(server, directory + "/daemon");
+        check(daemon.is_up(), "the headless server came up");
+        TestConnection control(daemon.socket_path());
+        auto pid = [&] { return std::atoi(control.request("query echo pid").c_str()); };
+        // sockets are passed from the next start on, so the first restart hands them to the worker
+        check(control.request("register echo " + executable + " " + directory) == "registered \"echo\"", "register");
+        check(control.request("listen echo " + echo_socket).starts_with("listening on"), "listen");
+        int last_pid = pid();
+        auto restart = [&] {
+            check(control.request("restart echo").starts_with("queued"), "restart");
+            int previous = last_pid;
+            check(wait_until([&] { return (last_pid = pid()) != previous; }, 10), "the worker got a new pid");
+        };
+        restart();
+        check(EchoConnection(echo_socket).echo("hello") == last_pid, "the worker echoes on its passed socket");
+
+        // opened before the handovers, so it's in flight while the old instance drains
+        EchoConnection in_flight(echo_socket);
+        const int in_flight_pid = in_flight.echo("first");
+        check(in_flight_pid == last_pid, "the in-flight connection is served");
+
+        std::atomic_bool stop { false };
+        std::atomic<int> requests { 0 };
+        std::mutex pids_mutex;
+        std::set<int> pids;
+        std::vector<std::thread> clients;
+        for (int t = 0; t < 4; ++t) {
+            clients.emplace_back([&] {
+                while (!stop) {
+                    int replied = EchoConnection(echo_socket).echo("ping");
+                    check(replied > 0, "a connection during handovers was served");
+                    requests += 1;
+                    std::lock_guard guard(pids_mutex);
+                    pids.insert(replied);
+                }
+            });
+        }
+        for (int i = 0; i < 5; ++i) {
+            restart();
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+        stop = true;
+        for (auto& client : clients) {
+            client.join();
+        }
+        check(in_flight.echo("last") == in_flight_pid, "the in-flight connection is still served by the old instance");
+        check(pids.size() >= 5, "clients were served by " + std::to_string(pids.size()) + " instances");
+        info(std::to_string(requests) + " connections served by " + std::to_string(pids.size()) + " instances across 5 handovers");
+
+        // a handover to an executable which can't be started must keep the old instance
+        const std::string broken = directory + "/broken";
+        std::ofstream(broken) << "not an executable\n";
+        std::filesystem::rename(broken, executable);
+        const int before = last_pid;
+        check(control.request("restart echo").starts_with("queued"), "restart with a broken executable");
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        check(pid() == before, "the old instance is still the worker after a failed handover");
+        check(control.request("query echo exited") == "false" && control.request("query echo signalled") == "false",
+            "the old instance is still running after a failed handover");
+        check(EchoConnection(echo_socket).echo("still there") == before, "the old instance still serves after a failed handover");
+        check(control.request("remove echo").starts_with("worker \"echo\""), "remove");
+    }
+    if (failures > 0) {
+        error(std::to_string(failures) + " checks failed, the daemon's output is in \"" + directory + "/daemon/daemon.out\"");
+        return 1;
+    }
+    std::filesystem::remove_all(directory);
+    info("passed");
+    return 0;
+}